@@ -0,0 +1,18 @@
+#ifndef EMBEDDEDFRAMES_H
+#define EMBEDDEDFRAMES_H
+
+#include <cstddef>
+
+/**
+ * \file
+ * The frames of the player packed into a frame archive and compiled into the executable, so it starts
+ * without opening any frame files. The definitions are generated by the embedframes tool when the player is
+ * built with BADAPPLE_EMBED_FRAMES, which also defines BADAPPLE_EMBEDDED_FRAMES for the player.
+ */
+
+// The archive, aligned to 8 bytes so it can be read in place, see FrameArchive
+extern const unsigned char EmbeddedFrames[];
+extern const size_t EmbeddedFramesSize;
+
+//EMBEDDEDFRAMES_H
+#endif
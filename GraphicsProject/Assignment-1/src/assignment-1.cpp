@@ -8,6 +8,9 @@
 #include <string>
 #include <algorithm>
 #include <chrono>
+#include <memory>
+
+#include <sys/stat.h>
 
 
 #include <GL/glew.h>
@@ -16,8 +19,18 @@
 #include "ifile.h"
 #include "glmutils.h"
 #include "linerasterizer.h"
+#include "shaderutils.h"
 #include "badapple.h"
+#include "framearchive.h"
+#include "levelselector.h"
+#include "framepacer.h"
+#include "framehash.h"
+#include "framescan.h"
+#include "options.h"
 #include "shader_path.h"
+#ifdef BADAPPLE_EMBEDDED_FRAMES
+#include "embeddedframes.h"
+#endif
 
 
 
@@ -75,13 +88,95 @@ float PointSize = 1.0f;
 float LineVertexScale = 1.0f / (glm::max(xmax, ymax) + 2.0f);
 
 // SETTINGS: Bad Apple variables
+// The player takes the frame size of the archive it opens, 48x36 is only the size until then
 BadApple badApple(48, 36, shader_path + "Frames/frame");
+std::string FrameArchivePath = shader_path + "Frames.bapl";
+// If not empty, the frames are played from this archive instead, e.g. one written by the extractor with --archive.
+// It is opened as it is, and never packed again or overwritten. Set with --archive <path>.
+std::string UserArchivePath;
+// If not empty, the frames are read from this raw frame stream instead of the archive, "-" for standard input.
+// Set with --stream <path>, e.g. from ffmpeg -i BadApple.mp4 -vf fps=6.2,scale=48:36 -pix_fmt monob -f rawvideo -
+// Add --gray8 for a stream of -pix_fmt gray frames.
+std::string FrameStreamPath;
+StreamFormat FrameStreamFormat = StreamFormat::Bits;
+unsigned int PrefetchDepth = 16;
 double fps = 6.2;
+// The most megabytes of decoded frames kept in memory, so looping and seeking back do not decode them again.
+// Set with --cache <megabytes>, 0 disables the cache.
+unsigned int FrameCacheMegabytes = 16;
+// If true, playback starts over at the first frame after the last. Set with --loop.
+bool LoopPlayback = false;
+
+// The levels packed into the archive, as divisors of the size of the bmp frames, which is read from the first frame.
+// Set with --levels, e.g. --levels 1,2,5,10 for the full size frames of the extractor with --scale 1, which gives
+// levels of 480x360, 240x180, 96x72 and 48x36.
+// Frames compiled into the player have the levels of BADAPPLE_EMBED_LEVELS in CMake instead.
+std::vector<unsigned int> LevelScales = { 1, 2, 4 };
+// The fraction of the time between frames that producing and drawing a frame may take before the player
+// downshifts to a smaller level
+double FrameBudget = 0.5;
+// The number of grid cells per pixel of the level being played
+float FrameScale = 1.0f;
+// How far the arrow keys jump, without and with shift held
+double ScrubSeconds = 5.0;
+double ScrubSecondsShift = 30.0;
 
-// runtime stuff
-std::chrono::time_point<std::chrono::steady_clock> loopStartTime, loopEndTime;
-std::chrono::duration<double, std::milli> timeSinceLastFrame;
+/**
+ * The ways a frame can be drawn
+ * \param DOTS - one point per dark pixel, all of them uploaded every frame.
+ * \param SPANS - one quad per run of dark pixels, all of them uploaded every frame.
+ * \param PIXELS - one point per pixel in a persistent buffer, only the changed pixels are uploaded.
+ * \param TEXTURE - the frame uploaded as a texture, and drawn as dots by one quad over the whole frame.
+ * \param POLYGONS - the outlines of the dark regions traced, simplified and triangulated, see framecontour.h.
+ * \param SEQUENCE - one point per dark pixel of every frame, uploaded once; each frame is drawn from its range.
+ * \param TILES - several sequences side by side, the points of all of them uploaded to one buffer and drawn at once.
+ */
+enum RenderMode { DOTS, SPANS, PIXELS, TEXTURE, POLYGONS, SEQUENCE, TILES, RENDERMODE_COUNT };
+const char* RenderModeNames[RENDERMODE_COUNT] = { "pixels as dots", "runs of pixels", "changed pixels only",
+    "a texture of the frame", "outlines as triangles", "the preloaded sequence", "tiles of several sequences" };
+RenderMode Mode = DOTS;
+
+// How far in pixels the outlines of the POLYGONS mode may stray from the pixels of the frame
+float PolygonTolerance = 0.4f;
+// If true, the triangles of the POLYGONS mode are rasterized on the CPU and drawn as dots, which shows
+// what the simplification loses. Toggled with R.
+bool RasterizePolygons = false;
+
+// The points of each frame in the sequence buffer, empty until the SEQUENCE mode is drawn the first time
+std::vector<FrameRange> SequenceRanges;
+// The level the sequence buffer holds
+unsigned int SequenceLevel = 0;
+// The frame drawn in SEQUENCE mode, 0 before the first. The mode plays from the buffer without reading frames.
+unsigned int SequenceFrameID = 0;
+
+// The number of sequences played in TILES mode, and the archives they are played from, taken in turn.
+// No archives plays the archive of the other modes. Set with --tiles <count>, which starts in TILES mode,
+// and --tile-archive <path>, which can be given once per archive.
+unsigned int TileCount = 4;
+std::vector<std::string> TileArchivePaths;
+// Each tile loads fewer frames ahead than the single player, as there are many of them
+unsigned int TilePrefetchDepth = 4;
+// The players of the tiles, created when the TILES mode is entered and released when it is left
+std::vector<std::unique_ptr<BadApple>> Tiles;
+// The center of each tile in the points of the tile grid
+std::vector<glm::ivec2> TileOffsets;
+// The number of grid cells per point of the tile grid, like FrameScale
+float TileScale = 1.0f;
+
+// Bytes of vertex data sent to the GPU
+uint64_t UploadedBytes = 0;
+uint64_t UploadedFrames = 0;
+
+// The hash of the frame in the buffers and the render mode it was generated for, so a frame which repeats it
+// is neither generated nor uploaded again. RENDERMODE_COUNT when the buffers hold no frame.
+uint64_t UploadedFrameHash = 0;
+RenderMode UploadedMode = RENDERMODE_COUNT;
+uint64_t RepeatedFrames = 0;
+
+// Where the statistics of the frame stage timings are written on exit and when T is pressed. Set with --timings <path>.
+std::string TimingsPath = "badapple-timings.csv";
 
+// runtime stuff
 bool CoordinatesChanged = false;
 bool NeedsUpdate = true;
 
@@ -237,30 +332,6 @@ std::ostream& operator<<(std::ostream& s, std::vector<glm::vec3> const& data)
     return s;
 }
 
-/**
- * Reads the contents of a text file and returns in as a string.
- * \param FileName - A string containing the name of the file to be read.
- * \return A sting containing the contents of the file.
- */
-std::string Read(std::string const& FileName)
-{
-    std::string resultprog;
-    InputFile Data(FileName);
-    while (!Data.eof()) {
-        std::string line;
-        std::getline(Data, line);
-        if (line.size() > 0) {
-            resultprog += line + '\n';
-        }
-    }
-    if (resultprog.size() <= 0) {
-        std::ostringstream errormessage;
-        errormessage << "No program found in file: " << FileName << std::endl;
-        throw std::runtime_error(errormessage.str().c_str());
-    }
-    return resultprog;
-}
-
 /**
  * Generates quadratic grid
  */
@@ -280,23 +351,400 @@ std::vector<glm::vec3> GenerateGridLines()
 }
 
 /**
- * Scanconverts a straight line, i.e. computes the pixels that represents the approximated straight line.
- * \param x1 - the x-coordinate of the start point.
- * \param y1 - the y-coordinate of the start point.
- * \param x2 - the x-coordinate of the end point.
- * \param y2 - the y-coordinate of the end point.
- * \return A std::vector which contains the coordinates of the pixels of a straight line.
+ * Computes the position of every pixel of a frame, centered like the points of BadApple::GenerateFramePoints().
+ * \param width - The width of the frame.
+ * \param height - The height of the frame.
+ * \return - A std::vector with width * height positions in the order of the frame data.
+ */
+std::vector<FramePoint> GeneratePixelGrid(unsigned int width, unsigned int height)
+{
+    std::vector<FramePoint> grid;
+    grid.reserve(width * height);
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            grid.push_back(FramePoint{ int16_t(int(x) - int(width / 2)), int16_t(int(y) - int(height / 2)) });
+        }
+    }
+    return grid;
+}
+
+/**
+ * Finds the largest level of the frame pyramid which has no more pixels than the window can show,
+ * given that a grid cell is PointSize pixels of the window.
+ * \param player - the player whose levels are searched.
+ * \param tiles - the number of frames shown side by side and on top of each other.
+ * \return - the level, 0 is the largest.
+ */
+unsigned int LargestLevelForWindow(const BadApple& player, glm::uvec2 tiles = glm::uvec2(1))
+{
+    for (unsigned int level = 0; level + 1 < player.GetLevelCount(); level++) {
+        glm::uvec2 size = player.GetLevelSize(level) * tiles;
+        if (size.x <= (xmax - xmin) * PointSize && size.y <= (ymax - ymin) * PointSize) {
+            return level;
+        }
+    }
+    return player.GetLevelCount() - 1;
+}
+
+/**
+ * Finds when a file was last modified.
+ * \param filepath - the path of the file.
+ * \return - the time in seconds, or -1 if the file does not exist.
+ */
+long long ModificationTime(const std::string& filepath)
+{
+#ifdef _WIN32
+    struct _stat64 fileStat;
+    if (_stat64(filepath.c_str(), &fileStat) != 0) return -1;
+#else
+    struct stat fileStat;
+    if (stat(filepath.c_str(), &fileStat) != 0) return -1;
+#endif
+    return (long long)fileStat.st_mtime;
+}
+
+/**
+ * Finds out whether an archive packed from bmp frames still holds those frames, e.g. after they were extracted again.
+ * It must have the levels of LevelScales, the size of the first frame and as many frames as there are files,
+ * and no file may be newer than it.
+ * \param archivePath - the archive.
+ * \param framesPath - the general filepath of the frames, "_<frame number>.bmp" is added to it.
+ * \param reason - receives why the archive is out of date.
+ * \return - true if the archive must be packed again.
  */
-std::vector<glm::vec3> GenerateFramePixels()
+bool ArchiveOutOfDate(const std::string& archivePath, const std::string& framesPath, std::string& reason)
 {
-    std::vector<glm::vec3> pixels;
-    badApple.ReadFrameAndIncrement();
-    pixels = badApple.GenerateFramePoints();
+    long long archiveTime = ModificationTime(archivePath);
+    if (archiveTime < 0 || !FrameArchive::IsArchive(archivePath)) {
+        reason = "there is no frame archive yet";
+        return true;
+    }
+    try {
+        FrameArchive archive(archivePath);
+        if (archive.LevelCount() != LevelScales.size()) {
+            reason = "the levels changed";
+            return true;
+        }
+        BMPFrameSource frames(framesPath, false);
+        if (archive.Width() != frames.Width() || archive.Height() != frames.Height()) {
+            reason = "the frames changed size";
+            return true;
+        }
+        unsigned int frameCount = 0;
+        for (long long frameTime; (frameTime = ModificationTime(framesPath + '_' + std::to_string(frameCount + 1) + ".bmp")) >= 0; ) {
+            if (frameTime > archiveTime) {
+                reason = "frame " + std::to_string(frameCount + 1) + " is newer than the archive";
+                return true;
+            }
+            frameCount++;
+        }
+        if (frameCount != archive.FrameCount()) {
+            reason = "there are " + std::to_string(frameCount) + " frames, the archive has " + std::to_string(archive.FrameCount());
+            return true;
+        }
+    }
+    catch (std::exception const& exception) {
+        reason = exception.what();
+        return true;
+    }
+    return false;
+}
 
+/**
+ * Finds the frame a tile starts at. The tiles are spread evenly over the video, tile 0 at the given frame.
+ * \param tile - the index of the tile.
+ * \param frameID - the frame of tile 0.
+ * \param frameCount - the number of frames of the video the tile plays.
+ * \return - the ID of the frame.
+ */
+unsigned int TileStartFrame(unsigned int tile, unsigned int frameID, unsigned int frameCount)
+{
+    if (frameCount == 0) return frameID;
+    return unsigned((frameID - 1 + uint64_t(tile) * frameCount / TileCount) % frameCount) + 1;
+}
+
+/**
+ * Creates the players of the TILES mode, arranged in a grid which is as square as possible, and places them.
+ * Each tile plays the largest level of its archive which lets the whole grid fit the window.
+ * A runtime_error is thrown if an archive can not be opened.
+ */
+void CreateTiles()
+{
+    Tiles.clear();
+    TileOffsets.clear();
+    const std::vector<std::string>& archives = TileArchivePaths;
+
+    unsigned int columns = unsigned(std::ceil(std::sqrt(double(TileCount))));
+    unsigned int rows = (TileCount + columns - 1) / columns;
+    glm::uvec2 grid(columns, rows);
+
+    // The cells of the grid are as large as the largest tile
+    glm::ivec2 cell(1);
+    for (unsigned int i = 0; i < TileCount; i++) {
+        std::unique_ptr<BadApple> tile(new BadApple(48, 36, shader_path + "Frames/frame"));
+        if (!archives.empty()) {
+            tile->OpenArchive(archives[i % archives.size()]);
+        }
+        else if (!UserArchivePath.empty()) {
+            // The frames of the other modes
+            tile->OpenArchive(UserArchivePath);
+        }
+        else {
+            // The frames of the other modes
+#ifdef BADAPPLE_EMBEDDED_FRAMES
+            tile->OpenEmbeddedArchive(EmbeddedFrames, EmbeddedFramesSize);
+#else
+            tile->OpenArchive(FrameArchivePath);
+#endif
+        }
+        tile->SetLevel(LargestLevelForWindow(*tile, grid));
+        tile->Seek(TileStartFrame(i, std::max(badApple.GetFrameID(), 1u), tile->GetFrameCount()));
+        tile->EnablePrefetch(TilePrefetchDepth);
+        cell = glm::max(cell, glm::ivec2(tile->GetWidth(), tile->GetHeight()));
+        Tiles.push_back(std::move(tile));
+    }
+
+    // Row 0 of the tiles is at the top, and the grid is centered like a single frame
+    glm::ivec2 size = cell * glm::ivec2(grid);
+    for (unsigned int i = 0; i < TileCount; i++) {
+        glm::ivec2 position(i % columns, rows - 1 - i / columns);
+        TileOffsets.push_back(position * cell + cell / 2 - size / 2);
+    }
+    TileScale = std::min(float(xmax - xmin) / size.x, float(ymax - ymin) / size.y);
+
+    // The tiles are new, so whatever was generated for the old ones is not reused
+    UploadedMode = RENDERMODE_COUNT;
+    std::cout << "BADAPPLE: playing " << TileCount << " tiles in a " << columns << "x" << rows << " grid of "
+        << cell.x << "x" << cell.y << " frames" << std::endl;
+}
+
+/**
+ * Reads the next frame of every tile. A tile starts over from the first frame when it reaches the end of its video.
+ * \return - a hash of the frames of all tiles, which like BadApple::GetFrameHash() is equal for equal frames.
+ */
+uint64_t ReadTileFrames()
+{
+    std::vector<uint64_t> hashes;
+    hashes.reserve(Tiles.size());
+    for (std::unique_ptr<BadApple>& tile : Tiles) {
+        if (tile->GetFrameCount() > 0 && tile->GetFrameID() >= tile->GetFrameCount()) {
+            tile->Seek(1u);
+        }
+        tile->ReadFrameAndIncrement();
+        hashes.push_back(tile->GetFrameHash());
+    }
+    return HashFrame(reinterpret_cast<const unsigned char*>(hashes.data()), hashes.size() * sizeof(uint64_t));
+}
+
+/**
+ * Appends the points of the frames of all tiles, each moved to its tile.
+ * \param points - A std::vector which receives the points of all tiles.
+ */
+void GenerateTilePoints(std::vector<FramePoint>& points)
+{
+    for (size_t i = 0; i < Tiles.size(); i++) {
+        Tiles[i]->AppendFramePoints(points, TileOffsets[i]);
+    }
+}
+
+/**
+ * Jumps forward or back in the video from the current frame.
+ * \param seconds - how far to jump, negative to jump back.
+ */
+void Scrub(double seconds)
+{
+    unsigned int frameID;
+    if (Mode == SEQUENCE) {
+        long target = long(SequenceFrameID) + std::lround(seconds * fps);
+        frameID = unsigned(std::max(std::min(target, long(SequenceRanges.size())), 1L));
+        // The next frame drawn is the one jumped to
+        SequenceFrameID = frameID - 1;
+    }
+    else if (Mode == TILES) {
+        // Every tile jumps as far, and the frame of the first tile is shown
+        if (Tiles.empty()) return;
+        for (std::unique_ptr<BadApple>& tile : Tiles) {
+            long target = long(tile->GetFrameID()) + std::lround(seconds * fps);
+            tile->Seek(unsigned(std::max(target, 1L)));
+        }
+        frameID = Tiles[0]->GetFrameID();
+    }
+    else {
+        long target = long(badApple.GetFrameID()) + std::lround(seconds * fps);
+        if (!badApple.Seek(unsigned(std::max(target, 1L)))) return;
+        frameID = badApple.GetFrameID();
+    }
+
+    double timestamp = (frameID - 1) / fps;
+    std::cout << "Frame " << frameID << " at " << int(timestamp) / 60 << ":" << std::setfill('0')
+        << std::setw(2) << int(timestamp) % 60 << std::setfill(' ') << std::endl;
+}
+
+/**
+ * Fills the persistent pixel buffers for the size of the current frame:
+ * the position of every pixel, and every pixel white, just like the base of BadApple::GenerateChangedRuns().
+ * \param gridbuffer - the buffer which receives the positions of the pixels.
+ * \param valuebuffer - the buffer which receives the value of the pixels.
+ * \return - the number of pixels.
+ */
+GLsizei InitializePixelBuffers(GLuint gridbuffer, GLuint valuebuffer)
+{
+    std::vector<FramePoint> PixelGrid = GeneratePixelGrid(badApple.GetWidth(), badApple.GetHeight());
+    glBindBuffer(GL_ARRAY_BUFFER, gridbuffer);
+    glBufferData(GL_ARRAY_BUFFER, PixelGrid.size() * sizeof(FramePoint), PixelGrid.data(), GL_STATIC_DRAW);
+
+    std::vector<unsigned char> WhiteFrame(PixelGrid.size(), UINT8_MAX);
+    glBindBuffer(GL_ARRAY_BUFFER, valuebuffer);
+    glBufferData(GL_ARRAY_BUFFER, WhiteFrame.size(), WhiteFrame.data(), GL_DYNAMIC_DRAW);
+
+    return GLsizei(PixelGrid.size());
+}
+
+/**
+ * Allocates the frame texture for the size of the current frame, and fills it with the current frame.
+ * \param texture - the texture which receives the frames in TEXTURE mode.
+ */
+void InitializeFrameTexture(GLuint texture)
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // The rows of a frame are not padded
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, badApple.GetWidth(), badApple.GetHeight(), 0, GL_RED, GL_UNSIGNED_BYTE,
+        badApple.GetFrameData());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Generates the points of every frame of the level being played and uploads them to one buffer,
+ * unless the buffer already holds them.
+ * \param sequencebuffer - the buffer which receives the points.
+ */
+void PreloadSequence(GLuint sequencebuffer)
+{
+    if (!SequenceRanges.empty() && SequenceLevel == badApple.GetLevel()) return;
+
+    std::vector<FramePoint> SequencePoints;
+    badApple.GenerateSequencePoints(SequencePoints, SequenceRanges);
+    SequenceLevel = badApple.GetLevel();
+
+    glBindBuffer(GL_ARRAY_BUFFER, sequencebuffer);
+    glBufferData(GL_ARRAY_BUFFER, SequencePoints.size() * sizeof(FramePoint),
+        SequencePoints.empty() ? nullptr : SequencePoints.data(), GL_STATIC_DRAW);
+    UploadedBytes += SequencePoints.size() * sizeof(FramePoint);
+    std::cout << "BADAPPLE: preloaded " << SequenceRanges.size() << " frames, "
+        << SequencePoints.size() * sizeof(FramePoint) << " bytes of points" << std::endl;
+}
+
+/**
+ * Reads the next frame of the video and computes the pixels that should be drawn in the current render mode.
+ * The outputs of the other render modes are cleared. In SEQUENCE mode nothing is read, the next frame is drawn
+ * from the sequence buffer.
+ * A frame equal to the frame in the buffers, like the frames of a still scene, or the current frame again when
+ * the prefetcher has no new frame ready, is not generated again, and the outputs are left as they are.
+ * \param pixels - A std::vector which receives the coordinates of the dark pixels of the frame in DOTS mode,
+ *                 or of the frames of all tiles in TILES mode.
+ * \param spans - A std::vector which receives the runs of dark pixels of the frame in SPANS mode.
+ * \param runs - A std::vector which receives the runs of pixels that changed since the last frame in PIXELS mode.
+ * \param triangles - A std::vector which receives the triangles of the frame in POLYGONS mode, or nothing
+ *                    if they are rasterized, in which case pixels receives the pixels they cover.
+ * \return - true if the outputs hold a new frame which should be uploaded, false if the buffers already hold it.
+ */
+bool GenerateFramePixels(std::vector<FramePoint>& pixels, std::vector<FrameSpan>& spans, std::vector<PixelRun>& runs,
+    std::vector<glm::vec2>& triangles)
+{
     CoordinatesChanged = true;
     NeedsUpdate = true;
+    if (Mode == SEQUENCE) {
+        pixels.clear();
+        spans.clear();
+        runs.clear();
+        triangles.clear();
+        UploadedMode = SEQUENCE;
+        if (SequenceFrameID < SequenceRanges.size()) {
+            SequenceFrameID++;
+        }
+        return true;
+    }
+
+    FrameTimings& timings = badApple.GetFrameTimings();
+    uint64_t hash;
+    {
+        StageTimer timer(timings, FrameStage::Load);
+        if (Mode == TILES) {
+            hash = ReadTileFrames();
+        }
+        else {
+            if (LoopPlayback && badApple.GetFrameCount() != 0 && badApple.GetFrameID() == badApple.GetFrameCount()) {
+                badApple.Seek(1u);
+            }
+            badApple.ReadFrameAndIncrement();
+            hash = badApple.GetFrameHash();
+        }
+    }
+    if (hash == UploadedFrameHash && Mode == UploadedMode) {
+        RepeatedFrames++;
+        return false;
+    }
+    UploadedFrameHash = hash;
+    UploadedMode = Mode;
+
+    pixels.clear();
+    spans.clear();
+    runs.clear();
+    triangles.clear();
+    StageTimer timer(timings, FrameStage::Points);
+    switch (Mode) {
+    case TILES:
+        GenerateTilePoints(pixels);
+        break;
+    case DOTS:
+        badApple.GenerateFramePoints(pixels);
+        break;
+    case SPANS:
+        badApple.GenerateFrameSpans(spans);
+        break;
+    case TEXTURE:
+        // The frame data is uploaded as it is
+        break;
+    case POLYGONS:
+        if (RasterizePolygons) {
+            badApple.GenerateRasterizedPoints(pixels, PolygonTolerance);
+        }
+        else {
+            badApple.GenerateFrameTriangles(triangles, PolygonTolerance);
+        }
+        break;
+    default:
+        badApple.GenerateChangedRuns(runs);
+        break;
+    }
+    return true;
+}
 
-    return pixels;
+
+/**
+ * Prints the minimum, mean and 99th percentile time of each stage of the frames, and writes the statistics
+ * of every stage to TimingsPath.
+ */
+void ReportFrameTimings()
+{
+    FrameTimings& timings = badApple.GetFrameTimings();
+    for (size_t i = 0; i < size_t(FrameStage::Count); i++) {
+        StageStats stats = timings.Stats(FrameStage(i));
+        std::cout << "BADAPPLE: " << FrameTimings::StageName(FrameStage(i)) << " of " << stats.count << " frames took "
+            << stats.min << " / " << stats.mean << " / " << stats.p99 << " ms (min / mean / p99)" << std::endl;
+    }
+    try {
+        timings.WriteCSV(TimingsPath);
+        std::cout << "BADAPPLE: wrote the frame timings to " << TimingsPath << std::endl;
+    }
+    catch (std::exception const& exception) {
+        std::cerr << exception.what() << std::endl;
+    }
 }
 
 
@@ -338,6 +786,15 @@ void KeyboardCallback(GLFWwindow* Window, int key, int scancode, int action, int
 {
     if (action == GLFW_RELEASE) return;
 
+    // Holding an arrow key keeps scrubbing
+    if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) {
+        double seconds = (mode & GLFW_MOD_SHIFT) ? ScrubSecondsShift : ScrubSeconds;
+        Scrub(key == GLFW_KEY_LEFT ? -seconds : seconds);
+        CoordinatesChanged = true;
+        NeedsUpdate = true;
+        return;
+    }
+
     if (action == GLFW_PRESS) {
         switch (key)
         {
@@ -346,7 +803,31 @@ void KeyboardCallback(GLFWwindow* Window, int key, int scancode, int action, int
             CoordinatesChanged = false;
             break;
         case GLFW_KEY_ENTER:
-            badApple.SetCurrentFrame(1u);
+            if (Mode == SEQUENCE) {
+                SequenceFrameID = 0;
+            }
+            else if (Mode == TILES) {
+                for (unsigned int i = 0; i < Tiles.size(); i++) {
+                    Tiles[i]->Seek(TileStartFrame(i, 1, Tiles[i]->GetFrameCount()));
+                }
+            }
+            else {
+                badApple.Seek(1u);
+            }
+            break;
+        case GLFW_KEY_M:
+            Mode = RenderMode((Mode + 1) % RENDERMODE_COUNT);
+            std::cout << "Drawing " << RenderModeNames[Mode] << std::endl;
+            break;
+        case GLFW_KEY_T:
+            ReportFrameTimings();
+            break;
+        case GLFW_KEY_R:
+            RasterizePolygons = !RasterizePolygons;
+            // The buffers hold the frame the other way
+            UploadedMode = RENDERMODE_COUNT;
+            std::cout << "BADAPPLE: polygons are " << (RasterizePolygons ? "rasterized on the CPU" : "drawn as triangles")
+                << std::endl;
             break;
         }
 
@@ -355,9 +836,43 @@ void KeyboardCallback(GLFWwindow* Window, int key, int scancode, int action, int
     }
 }
 
-int main()
+int main(int argc, char** argv)
 {
     try {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+            if (argument == "--stream" && i + 1 < argc) {
+                FrameStreamPath = argv[++i];
+            }
+            else if (argument == "--gray8") {
+                FrameStreamFormat = StreamFormat::Gray8;
+            }
+            else if (argument == "--tiles" && i + 1 < argc) {
+                TileCount = std::max(ParseNumber(argv[++i], argument), 1);
+                Mode = TILES;
+            }
+            else if (argument == "--archive" && i + 1 < argc) {
+                UserArchivePath = argv[++i];
+            }
+            else if (argument == "--tile-archive" && i + 1 < argc) {
+                TileArchivePaths.push_back(argv[++i]);
+            }
+            else if (argument == "--timings" && i + 1 < argc) {
+                TimingsPath = argv[++i];
+            }
+            else if (argument == "--cache" && i + 1 < argc) {
+                FrameCacheMegabytes = unsigned(std::max(ParseNumber(argv[++i], argument), 0));
+            }
+            else if (argument == "--levels" && i + 1 < argc) {
+                LevelScales = ParseScales(argv[++i], argument);
+            }
+            else if (argument == "--loop") {
+                LoopPlayback = true;
+            }
+        }
+
+
         // GLenum Error = GL_NO_ERROR;
  #pragma region Initialization
 
@@ -607,9 +1122,43 @@ int main()
 
         // This where the dots of the lines initialized
 
+        badApple.SetFrameCacheBudget(size_t(FrameCacheMegabytes) << 20);
+        if (!FrameStreamPath.empty()) {
+            // Play the frames as they arrive, without packing them first
+            badApple.OpenStream(FrameStreamPath, 48, 36, FrameStreamFormat);
+        }
+        else if (!UserArchivePath.empty()) {
+            badApple.OpenArchive(UserArchivePath);
+        }
+#ifdef BADAPPLE_EMBEDDED_FRAMES
+        else {
+            // The frames were packed when the player was built
+            badApple.OpenEmbeddedArchive(EmbeddedFrames, EmbeddedFramesSize);
+        }
+#else
+        else {
+            // Pack the bmp frames into one archive the first time the player runs, or when the archive no longer
+            // matches the frames, and play from the archive
+            std::string reason;
+            if (ArchiveOutOfDate(FrameArchivePath, shader_path + "Frames/frame", reason)) {
+                std::cout << "BADAPPLE: packing the frames into " << FrameArchivePath << ", " << reason << std::endl;
+                BMPFrameSource frames(shader_path + "Frames/frame", false);
+                FrameArchive::Pack(frames, FrameArchivePath, FrameArchive::DefaultKeyframeInterval, LevelScales);
+            }
+            badApple.OpenArchive(FrameArchivePath);
+        }
+#endif
+        badApple.EnablePrefetch(PrefetchDepth);
+        std::cout << "BADAPPLE: scanning frames with " << FrameScanInstructionSet() << std::endl;
+        FrameScale = float(xmax - xmin) / badApple.GetWidth();
+        LevelSelector levelSelector(badApple.GetLevelCount());
+
         // User data
-        std::vector<glm::vec3> FramePixels;
-        FramePixels = GenerateFramePixels();
+        std::vector<FramePoint> FramePixels;
+        std::vector<FrameSpan> FrameSpans;
+        std::vector<PixelRun> ChangedRuns;
+        std::vector<glm::vec2> FrameTriangles;
+        GenerateFramePixels(FramePixels, FrameSpans, ChangedRuns, FrameTriangles);
         //std::cout << LinePixels << std::endl;
 
         // Make a VertexArrayObject - it is used by the VertexArrayBuffer, and it must be declared!
@@ -624,7 +1173,7 @@ int main()
 
         // Give our vertices to OpenGL.
         if (FramePixels.size() > 0) {
-            glBufferData(GL_ARRAY_BUFFER, FramePixels.size() * sizeof(float) * 3, &(FramePixels[0][0]), GL_STATIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, FramePixels.size() * sizeof(FramePoint), FramePixels.data(), GL_STATIC_DRAW);
         }
 
         // Validate the dot shader program
@@ -647,11 +1196,109 @@ int main()
 
         // Initialize dot Attributes
         GLuint dotvertexattribute = glGetAttribLocation(dotshaderID, "VertexPosition");
-        glVertexAttribPointer(dotvertexattribute, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(dotvertexattribute, 2, GL_SHORT, GL_FALSE, 0, 0);
 
         // Unbind the vertex array
         glBindVertexArray(0);
 
+        // This is where the runs of pixels are initialized. Each run is an instance of a quad.
+        GLuint spanshaderID = CreateShaderProgram(shader_path + "spanvertex.vert", shader_path + "linefragment.frag");
+
+        GLuint SpanVertexArrayID;
+        glGenVertexArrays(1, &SpanVertexArrayID);
+        glBindVertexArray(SpanVertexArrayID);
+
+        GLuint spanvertexbuffer;
+        glGenBuffers(1, &spanvertexbuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, spanvertexbuffer);
+
+        ValidateShader(spanshaderID, "Validating the span shader program");
+
+        GLuint spanvertexscale = glGetUniformLocation(spanshaderID, "Scale");
+        GLuint spanfragmentcolor = glGetUniformLocation(spanshaderID, "Color");
+
+        GLuint spanattribute = glGetAttribLocation(spanshaderID, "Span");
+        glVertexAttribPointer(spanattribute, 3, GL_FLOAT, GL_FALSE, sizeof(FrameSpan), 0);
+        glVertexAttribDivisor(spanattribute, 1);
+
+        glBindVertexArray(0);
+
+        // This is where the persistent pixels are initialized. Every pixel of the frame has a fixed position,
+        // and only the bytes of the pixels which changed are uploaded for each frame.
+        GLuint pixelshaderID = CreateShaderProgram(shader_path + "pixelvertex.vert", shader_path + "dotfragment.frag");
+
+        GLuint PixelGridVertexArrayID;
+        glGenVertexArrays(1, &PixelGridVertexArrayID);
+        glBindVertexArray(PixelGridVertexArrayID);
+
+        GLuint pixelgridbuffer;
+        GLuint pixelvaluebuffer;
+        glGenBuffers(1, &pixelgridbuffer);
+        glGenBuffers(1, &pixelvaluebuffer);
+        GLsizei PixelCount = InitializePixelBuffers(pixelgridbuffer, pixelvaluebuffer);
+
+        ValidateShader(pixelshaderID, "Validating the pixel shader program");
+
+        GLuint pixelvertexscale = glGetUniformLocation(pixelshaderID, "Scale");
+        GLuint pixelvertexpointsize = glGetUniformLocation(pixelshaderID, "PointSize");
+        GLuint pixelfragmentcolor = glGetUniformLocation(pixelshaderID, "Color");
+
+        GLuint pixelpositionattribute = glGetAttribLocation(pixelshaderID, "VertexPosition");
+        glBindBuffer(GL_ARRAY_BUFFER, pixelgridbuffer);
+        glVertexAttribPointer(pixelpositionattribute, 2, GL_SHORT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, pixelvaluebuffer);
+        GLuint pixelvalueattribute = glGetAttribLocation(pixelshaderID, "Pixel");
+        glVertexAttribPointer(pixelvalueattribute, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+
+        glBindVertexArray(0);
+
+        // This is where the triangles of the POLYGONS mode are initialized. They are drawn with the line shader,
+        // whose positions are three floats; the triangles have two, and z is then 0.
+        GLuint PolygonVertexArrayID;
+        glGenVertexArrays(1, &PolygonVertexArrayID);
+        glBindVertexArray(PolygonVertexArrayID);
+
+        GLuint polygonvertexbuffer;
+        glGenBuffers(1, &polygonvertexbuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, polygonvertexbuffer);
+        glVertexAttribPointer(linearvertexattribute, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindVertexArray(0);
+
+        // This is where the whole sequence is kept for the SEQUENCE mode. It is drawn with the dot shader,
+        // and filled the first time the mode is drawn.
+        GLuint SequenceVertexArrayID;
+        glGenVertexArrays(1, &SequenceVertexArrayID);
+        glBindVertexArray(SequenceVertexArrayID);
+
+        GLuint sequencevertexbuffer;
+        glGenBuffers(1, &sequencevertexbuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, sequencevertexbuffer);
+        glVertexAttribPointer(dotvertexattribute, 2, GL_SHORT, GL_FALSE, 0, 0);
+
+        glBindVertexArray(0);
+
+        // This is where the frame texture is initialized. The quad over the frame has no vertex data,
+        // its corners come from the vertex IDs.
+        GLuint textureshaderID = CreateShaderProgram(shader_path + "texturevertex.vert", shader_path + "texturefragment.frag");
+
+        GLuint TextureVertexArrayID;
+        glGenVertexArrays(1, &TextureVertexArrayID);
+
+        GLuint frametexture;
+        glGenTextures(1, &frametexture);
+        InitializeFrameTexture(frametexture);
+
+        ValidateShader(textureshaderID, "Validating the texture shader program");
+
+        GLuint texturevertexscale = glGetUniformLocation(textureshaderID, "Scale");
+        GLuint textureframesize = glGetUniformLocation(textureshaderID, "FrameSize");
+        GLuint texturecellsize = glGetUniformLocation(textureshaderID, "CellSize");
+        GLuint texturedotsize = glGetUniformLocation(textureshaderID, "DotSize");
+        GLuint texturefragmentcolor = glGetUniformLocation(textureshaderID, "Color");
+        GLuint textureframe = glGetUniformLocation(textureshaderID, "Frame");
+
 
         // Set the point size - make the size of the dot be a little smaller than the minimum distance
         // between the grid lines
@@ -667,14 +1314,61 @@ int main()
         std::cout << "* Bad Apple Music Video in DIKU's Graphics Programming Framework     *" << std::endl;
         std::cout << "*                                                                    *" << std::endl;
         std::cout << "* Press ENTER to reset                                               *" << std::endl;
+        std::cout << "* Press LEFT or RIGHT to jump 5 seconds, with SHIFT 30 seconds       *" << std::endl;
+        std::cout << "* Press M to switch between dots, runs of pixels, changed pixels,    *" << std::endl;
+        std::cout << "*   a texture of the frame, triangles, the preloaded sequence        *" << std::endl;
+        std::cout << "*   and tiles                                                        *" << std::endl;
+        std::cout << "* Press R to rasterize the triangles on the CPU or draw them with GL *" << std::endl;
+        std::cout << "* Press T to print the frame timings and write them to a CSV file    *" << std::endl;
         std::cout << "* Press ESC to finish the program                                    *" << std::endl;
         std::cout << "**********************************************************************" << std::endl;
         std::cout << std::endl;
         #pragma endregion
 
+        // The loop sleeps until the next frame is due, or until an event wakes it
+        FramePacer pacer(fps);
+        // The mode given on the command line is entered like any other
+        RenderMode DrawnMode = DOTS;
         while (!glfwWindowShouldClose(Window)) {
             try {
-                loopStartTime = std::chrono::steady_clock::now();
+                // The SEQUENCE mode keeps its own position, so the frame source stops while it is drawn,
+                // and the TILES mode plays from players of its own
+                if (Mode != DrawnMode) {
+                    if (DrawnMode == SEQUENCE) {
+                        // Playback goes on from the frame the sequence was at
+                        badApple.EnablePrefetch(PrefetchDepth);
+                        badApple.Seek(std::max(SequenceFrameID, 1u));
+                    }
+                    else if (DrawnMode == TILES) {
+                        Tiles.clear();
+                    }
+                    DrawnMode = Mode;
+
+                    try {
+                        if (Mode == SEQUENCE) {
+                            PreloadSequence(sequencevertexbuffer);
+                            SequenceFrameID = badApple.GetFrameID();
+                            badApple.EnablePrefetch(0);
+                        }
+                        else if (Mode == TILES) {
+                            CreateTiles();
+                        }
+                    }
+                    catch (std::exception const& exception) {
+                        // Nothing of the mode was set up, so the next mode is entered as if coming from DOTS
+                        std::cerr << exception.what() << std::endl;
+                        Tiles.clear();
+                        DrawnMode = DOTS;
+                        Mode = RenderMode((Mode + 1) % RENDERMODE_COUNT);
+                        std::cout << "Drawing " << RenderModeNames[Mode] << std::endl;
+                    }
+                }
+
+                if (pacer.Due()) {
+                    pacer.Advance();
+                    CoordinatesChanged = true;
+                    NeedsUpdate = true;
+                }
                 if (NeedsUpdate) {
                     glfwMakeContextCurrent(Window);
                     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -692,48 +1386,206 @@ int main()
                     glDisableVertexAttribArray(linearvertexattribute);
                     glUseProgram(0);
 
-                    // Generate dots
-                    glUseProgram(dotshaderID);
-                    glUniform1f(dotvertexscale, LineVertexScale);
-                    glUniform1f(dotvertexpointsize, PointSize);
-                    glUniform3f(dotfragmentcolor, 0.0f, 0.0f, 0.0f);
-
-                    glBindVertexArray(PixelVertexArrayID);
-                    glEnableVertexAttribArray(dotvertexattribute);
-                    if (CoordinatesChanged) {
-                        FramePixels = GenerateFramePixels();
-                        glBindBuffer(GL_ARRAY_BUFFER, dotvertexbuffer);
+                    std::chrono::time_point<std::chrono::steady_clock> frameStartTime = std::chrono::steady_clock::now();
+                    // A frame which repeats the frame in the buffers is drawn from them as they are
+                    if (CoordinatesChanged && GenerateFramePixels(FramePixels, FrameSpans, ChangedRuns, FrameTriangles)) {
+                        StageTimer uploadTimer(badApple.GetFrameTimings(), FrameStage::Upload);
                         if (FramePixels.size() > 0) {
-                            glBufferData(GL_ARRAY_BUFFER, FramePixels.size() * sizeof(float) * 3, &(FramePixels[0][0]),
+                            glBindBuffer(GL_ARRAY_BUFFER, dotvertexbuffer);
+                            glBufferData(GL_ARRAY_BUFFER, FramePixels.size() * sizeof(FramePoint), FramePixels.data(),
                                 GL_STATIC_DRAW);
+                            UploadedBytes += FramePixels.size() * sizeof(FramePoint);
                         }
+                        if (FrameSpans.size() > 0) {
+                            glBindBuffer(GL_ARRAY_BUFFER, spanvertexbuffer);
+                            glBufferData(GL_ARRAY_BUFFER, FrameSpans.size() * sizeof(FrameSpan), FrameSpans.data(),
+                                GL_STATIC_DRAW);
+                            UploadedBytes += FrameSpans.size() * sizeof(FrameSpan);
+                        }
+                        if (FrameTriangles.size() > 0) {
+                            glBindBuffer(GL_ARRAY_BUFFER, polygonvertexbuffer);
+                            glBufferData(GL_ARRAY_BUFFER, FrameTriangles.size() * sizeof(glm::vec2), FrameTriangles.data(),
+                                GL_STATIC_DRAW);
+                            UploadedBytes += FrameTriangles.size() * sizeof(glm::vec2);
+                        }
+                        if (ChangedRuns.size() > 0) {
+                            // The buffer keeps the previous frame, so only the changed pixels are overwritten
+                            const unsigned char* frame = badApple.GetFrameData();
+                            glBindBuffer(GL_ARRAY_BUFFER, pixelvaluebuffer);
+                            for (const PixelRun& run : ChangedRuns) {
+                                glBufferSubData(GL_ARRAY_BUFFER, run.begin, run.length, frame + run.begin);
+                                UploadedBytes += run.length;
+                            }
+                        }
+                        if (Mode == TEXTURE) {
+                            // The whole frame, however many pixels are dark
+                            glBindTexture(GL_TEXTURE_2D, frametexture);
+                            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, badApple.GetWidth(), badApple.GetHeight(), GL_RED,
+                                GL_UNSIGNED_BYTE, badApple.GetFrameData());
+                            glBindTexture(GL_TEXTURE_2D, 0);
+                            UploadedBytes += badApple.GetWidth() * badApple.GetHeight();
+                        }
+                        UploadedFrames++;
                     }
-                    if (FramePixels.size() > 0) {
+
+                    // The draw calls of the frame, without the grid
+                    FrameTimings::Clock::time_point drawStartTime = FrameTimings::Clock::now();
+
+                    // Generate dots, of one frame, of all tiles or of the rasterized triangles
+                    if ((Mode == DOTS || Mode == TILES || Mode == POLYGONS) && FramePixels.size() > 0) {
+                        float scale = Mode == TILES ? TileScale : FrameScale;
+                        glUseProgram(dotshaderID);
+                        glUniform1f(dotvertexscale, LineVertexScale * scale);
+                        glUniform1f(dotvertexpointsize, PointSize * scale);
+                        glUniform3f(dotfragmentcolor, 0.0f, 0.0f, 0.0f);
+
+                        glBindVertexArray(PixelVertexArrayID);
+                        glEnableVertexAttribArray(dotvertexattribute);
                         glDrawArrays(GL_POINTS, 0, FramePixels.size());
+                        glDisableVertexAttribArray(dotvertexattribute);
+                        glUseProgram(0);
+                    }
+
+                    // Generate runs of pixels
+                    if (Mode == SPANS && FrameSpans.size() > 0) {
+                        glUseProgram(spanshaderID);
+                        glUniform1f(spanvertexscale, LineVertexScale * FrameScale);
+                        glUniform3f(spanfragmentcolor, 0.0f, 0.0f, 0.0f);
+
+                        glBindVertexArray(SpanVertexArrayID);
+                        glEnableVertexAttribArray(spanattribute);
+                        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(FrameSpans.size()));
+                        glDisableVertexAttribArray(spanattribute);
+                        glUseProgram(0);
+                    }
+
+                    // Generate the triangles of the outlines
+                    if (Mode == POLYGONS && FrameTriangles.size() > 0) {
+                        glUseProgram(lineshaderID);
+                        glUniform1f(linevertexscale, LineVertexScale * FrameScale);
+                        glUniform3f(linefragmentcolor, 0.0f, 0.0f, 0.0f);
+
+                        glBindVertexArray(PolygonVertexArrayID);
+                        glEnableVertexAttribArray(linearvertexattribute);
+                        glDrawArrays(GL_TRIANGLES, 0, GLsizei(FrameTriangles.size()));
+                        glDisableVertexAttribArray(linearvertexattribute);
+                        glUseProgram(0);
+                    }
+
+                    // Generate the persistent pixels; the white ones are discarded by the vertex shader
+                    if (Mode == PIXELS) {
+                        glUseProgram(pixelshaderID);
+                        glUniform1f(pixelvertexscale, LineVertexScale * FrameScale);
+                        glUniform1f(pixelvertexpointsize, PointSize * FrameScale);
+                        glUniform3f(pixelfragmentcolor, 0.0f, 0.0f, 0.0f);
+
+                        glBindVertexArray(PixelGridVertexArrayID);
+                        glEnableVertexAttribArray(pixelpositionattribute);
+                        glEnableVertexAttribArray(pixelvalueattribute);
+                        glDrawArrays(GL_POINTS, 0, PixelCount);
+                        glDisableVertexAttribArray(pixelvalueattribute);
+                        glDisableVertexAttribArray(pixelpositionattribute);
+                        glUseProgram(0);
+                    }
+
+                    // Draw the frame texture as dots with one quad
+                    if (Mode == TEXTURE) {
+                        int framebufferwidth, framebufferheight;
+                        glfwGetFramebufferSize(Window, &framebufferwidth, &framebufferheight);
+                        float scale = LineVertexScale * FrameScale;
+
+                        glUseProgram(textureshaderID);
+                        glUniform1f(texturevertexscale, scale);
+                        glUniform2f(textureframesize, float(badApple.GetWidth()), float(badApple.GetHeight()));
+                        glUniform2f(texturecellsize, scale * framebufferwidth / 2.0f, scale * framebufferheight / 2.0f);
+                        glUniform1f(texturedotsize, PointSize * FrameScale);
+                        glUniform3f(texturefragmentcolor, 0.0f, 0.0f, 0.0f);
+                        glUniform1i(textureframe, 0);
+
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, frametexture);
+                        glBindVertexArray(TextureVertexArrayID);
+                        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                        glBindTexture(GL_TEXTURE_2D, 0);
+                        glUseProgram(0);
+                    }
+
+                    // Draw the points of the current frame straight from the sequence buffer
+                    if (Mode == SEQUENCE && SequenceFrameID >= 1 && SequenceRanges[SequenceFrameID - 1].count > 0) {
+                        const FrameRange& range = SequenceRanges[SequenceFrameID - 1];
+                        glUseProgram(dotshaderID);
+                        glUniform1f(dotvertexscale, LineVertexScale * FrameScale);
+                        glUniform1f(dotvertexpointsize, PointSize * FrameScale);
+                        glUniform3f(dotfragmentcolor, 0.0f, 0.0f, 0.0f);
+
+                        glBindVertexArray(SequenceVertexArrayID);
+                        glEnableVertexAttribArray(dotvertexattribute);
+                        glDrawArrays(GL_POINTS, GLint(range.first), GLsizei(range.count));
+                        glDisableVertexAttribArray(dotvertexattribute);
+                        glUseProgram(0);
+                    }
+                    badApple.GetFrameTimings().Record(FrameStage::Draw, FrameTimings::Clock::now() - drawStartTime);
+
+                    // Pick the level for the next frame from the window size and the time this frame took.
+                    // The sequence buffer holds one level, so it is kept while the SEQUENCE mode is drawn,
+                    // and the tiles keep the levels they were created with.
+                    if (CoordinatesChanged && Mode != SEQUENCE && Mode != TILES) {
+                        std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStartTime;
+                        levelSelector.SetLargestLevel(LargestLevelForWindow(badApple));
+                        unsigned int level = levelSelector.Update(frameTime.count(), FrameBudget * 1000.0 / fps);
+                        if (level != badApple.GetLevel()) {
+                            badApple.SetLevel(level);
+                            FrameScale = float(xmax - xmin) / badApple.GetWidth();
+                            PixelCount = InitializePixelBuffers(pixelgridbuffer, pixelvaluebuffer);
+                            InitializeFrameTexture(frametexture);
+                            std::cout << "BADAPPLE: playing level " << level << " (" << badApple.GetWidth() << "x"
+                                << badApple.GetHeight() << ")" << std::endl;
+                        }
                     }
-                    glDisableVertexAttribArray(dotvertexattribute);
-                    glUseProgram(0);
 
                     // Render frame
-                    glfwSwapBuffers(Window);
+                    {
+                        StageTimer timer(badApple.GetFrameTimings(), FrameStage::Swap);
+                        glfwSwapBuffers(Window);
+                    }
 
                     CoordinatesChanged = false;
                     NeedsUpdate = false;
                 }
-                glfwPollEvents();
 
-                loopEndTime = std::chrono::steady_clock::now();
-                timeSinceLastFrame += loopEndTime - loopStartTime;
-                if (timeSinceLastFrame.count() >= 1000.0 / (fps)) {
-                    CoordinatesChanged = true;
-                    NeedsUpdate = true;
-                    timeSinceLastFrame = std::chrono::duration<double, std::milli>(0.0);
+                double wait = pacer.SecondsUntilDue();
+                if (wait > 0.0) {
+                    glfwWaitEventsTimeout(wait);
+                }
+                else {
+                    glfwPollEvents();
                 }
             }
             catch (std::exception& Exception) {
                 std::cerr << Exception.what() << std::endl;
             }
         }
+
+        PrefetchStats prefetchStats = badApple.GetPrefetchStats();
+        std::cout << "BADAPPLE: prefetched " << prefetchStats.framesLoaded << " frames, played "
+            << prefetchStats.framesDelivered << " frames, " << prefetchStats.underruns << " underruns" << std::endl;
+        FrameStoreStats storeStats = badApple.GetFrameStoreStats();
+        std::cout << "BADAPPLE: " << storeStats.allocations << " frame buffers allocated (" << storeStats.bytesAllocated
+            << " bytes), " << storeStats.reuses << " of " << storeStats.acquires << " acquires reused a buffer" << std::endl;
+        FrameCacheStats cacheStats = badApple.GetFrameCacheStats();
+        std::cout << "BADAPPLE: " << cacheStats.hits << " frames read from the frame cache and " << cacheStats.misses
+            << " from the source, " << cacheStats.evictions << " evictions, " << cacheStats.frames << " frames ("
+            << cacheStats.bytes << " of " << cacheStats.budget << " bytes) cached" << std::endl;
+        std::cout << "BADAPPLE: " << levelSelector.Downshifts() << " downshifts and " << levelSelector.Upshifts()
+            << " upshifts of the level" << std::endl;
+        std::cout << "BADAPPLE: " << pacer.LateFrames() << " of " << pacer.Frames() << " frames started late (at most "
+            << pacer.MaxLateMilliseconds() << " ms), " << pacer.SkippedDeadlines() << " frame deadlines skipped" << std::endl;
+        if (UploadedFrames > 0) {
+            std::cout << "BADAPPLE: uploaded " << UploadedBytes / UploadedFrames << " bytes per frame on average" << std::endl;
+        }
+        std::cout << "BADAPPLE: " << RepeatedFrames << " frames repeated the frame before them and were not uploaded again"
+            << std::endl;
+        ReportFrameTimings();
     }
     catch (std::exception const& runtimeerror) {
         std::cerr << "Exception: " << runtimeerror.what() << std::endl;
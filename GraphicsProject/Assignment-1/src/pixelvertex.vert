@@ -0,0 +1,20 @@
+#version 330 core
+
+uniform float Scale;
+uniform float PointSize;
+
+// Every pixel of the frame has a fixed position; only its brightness is uploaded when it changes.
+// Positions are two shorts of grid coordinates, so z is 0.
+in vec3 VertexPosition;
+in float Pixel;
+
+void main() {
+    gl_PointSize = PointSize;
+    if (Pixel < 1.0) {
+        gl_Position = vec4(Scale * VertexPosition.xy, VertexPosition.z, 1.0);
+    }
+    else {
+        // White pixels are moved outside the clip volume
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    }
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform float Scale;
+
+// A run of dark pixels: the first pixel, one past the last pixel and the scanline
+in vec3 Span;
+
+void main() {
+    // Each span is drawn as an instanced quad; the corner comes from the vertex ID of the triangle strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    float x = mix(Span.x - 0.45, Span.y - 0.55, corner.x);
+    float y = Span.z - 0.45 + 0.9 * corner.y;
+    gl_Position = vec4(Scale * vec2(x, y), 0.0, 1.0);
+}
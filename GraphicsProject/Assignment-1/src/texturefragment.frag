@@ -0,0 +1,24 @@
+#version 330 core
+
+uniform vec3 Color;
+// The frame, one byte per pixel, where 1.0 is a white pixel
+uniform sampler2D Frame;
+// The size of a pixel of the frame in pixels of the window
+uniform vec2 CellSize;
+// The diameter of a dot in pixels of the window, like the point size of the dots
+uniform float DotSize;
+
+in vec2 FramePosition;
+
+out vec4 FragColor;
+
+void main() {
+    // Every pixel of the frame is a round dot around its center, like the points of dotfragment.frag
+    vec2 pixel = min(floor(FramePosition + 0.5), vec2(textureSize(Frame, 0) - 1));
+    vec2 offset = (FramePosition - pixel) * CellSize;
+    if (texelFetch(Frame, ivec2(pixel), 0).r >= 1.0 || dot(offset, offset) > 0.25 * DotSize * DotSize)
+        discard;
+    else {
+        FragColor = vec4(Color, 1.0f);
+    }
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+uniform float Scale;
+// The width and height of the frame in pixels
+uniform vec2 FrameSize;
+
+// The position in the frame, in pixels, where pixel (x, y) has its center at (x, y)
+out vec2 FramePosition;
+
+void main() {
+    // One quad covers the whole frame; the corner comes from the vertex ID of the triangle strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    FramePosition = mix(vec2(-0.5), FrameSize - 0.5, corner);
+    // Centered like the points of the other render modes
+    gl_Position = vec4(Scale * (FramePosition - floor(FrameSize / 2.0)), 0.0, 1.0);
+}
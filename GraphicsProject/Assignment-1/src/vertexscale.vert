@@ -3,6 +3,8 @@
 uniform float Scale;
 uniform float PointSize;
 
+// Grid lines are three floats, but frame points are two shorts of grid coordinates,
+// which are converted to float, and z is then 0
 in vec3 VertexPosition;
 
 void main() {
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "framearchive.h"
+#include "framesource.h"
+#include "options.h"
+
+/**
+ * \file
+ * Packs the bmp frames of the player into a frame archive and writes the archive as a C++ source file,
+ * which the build compiles into the player when BADAPPLE_EMBED_FRAMES is on. See embeddedframes.h.
+ */
+
+/**
+ * What is packed, and where it is written
+ * \param framesPath - the general filepath of the frames, "_<frame number>.bmp" is added to it.
+ * \param archivePath - the archive which is packed and then embedded.
+ * \param sourcePath - the C++ source file which is written.
+ * \param width - the width of the frames, 0 to take the size of the first frame.
+ * \param height - the height of the frames, 0 to take the size of the first frame.
+ * \param keyframeInterval - the maximum distance between keyframes in the archive.
+ * \param levelScales - the levels of the archive, as divisors of the frame size.
+ */
+struct EmbedSettings {
+    std::string framesPath;
+    std::string archivePath;
+    std::string sourcePath;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int keyframeInterval = FrameArchive::DefaultKeyframeInterval;
+    std::vector<unsigned int> levelScales = { 1 };
+};
+
+// The bytes written on each line of the array
+static const size_t BytesPerLine = 16;
+
+/**
+ * Reads a whole file.
+ * A runtime_error is thrown if the file can not be read.
+ * \param filepath - The path to the file.
+ * \return The bytes of the file.
+ */
+static std::vector<unsigned char> ReadFile(const std::string& filepath)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("embedframes: could not open " + filepath);
+    }
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (file.bad()) {
+        throw std::runtime_error("embedframes: could not read " + filepath);
+    }
+    return data;
+}
+
+/**
+ * Writes data as the definition of EmbeddedFrames and EmbeddedFramesSize.
+ * A runtime_error is thrown if the file can not be written.
+ * \param data - The archive.
+ * \param settings - Where the archive came from, and the path of the file to write.
+ */
+static void WriteSource(const std::vector<unsigned char>& data, const EmbedSettings& settings)
+{
+    std::ofstream source(settings.sourcePath);
+    if (!source) {
+        throw std::runtime_error("embedframes: could not open " + settings.sourcePath + " for writing");
+    }
+    source << "// Generated by embedframes from " << settings.framesPath << "_<frame number>.bmp, do not edit\n"
+        << "#include \"embeddedframes.h\"\n\n"
+        << "alignas(8) extern constexpr unsigned char EmbeddedFrames[] = {\n";
+
+    char byte[8];
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        snprintf(byte, sizeof(byte), "0x%02x,", data[i]);
+        source << (i % BytesPerLine == 0 ? "    " : " ") << byte;
+        if (i % BytesPerLine == BytesPerLine - 1 || i + 1 == data.size()) {
+            source << '\n';
+        }
+    }
+    source << "};\n\n"
+        << "extern constexpr size_t EmbeddedFramesSize = sizeof(EmbeddedFrames);\n";
+
+    if (!source) {
+        throw std::runtime_error("embedframes: could not write " + settings.sourcePath);
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        EmbedSettings settings;
+        std::vector<std::string> paths;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+            if (argument == "--size" && i + 2 < argc) {
+                int width = ParseNumber(argv[++i], argument);
+                int height = ParseNumber(argv[++i], argument);
+                if (width < 1 || height < 1) {
+                    throw std::runtime_error("embedframes: --size needs a width and height of at least 1");
+                }
+                settings.width = unsigned(width);
+                settings.height = unsigned(height);
+            }
+            else if (argument == "--keyframes" && i + 1 < argc) {
+                settings.keyframeInterval = unsigned(std::max(0, ParseNumber(argv[++i], argument)));
+            }
+            else if (argument == "--levels" && i + 1 < argc) {
+                // A comma separated list of scales, like 1,2,4
+                settings.levelScales = ParseScales(argv[++i], argument);
+            }
+            else {
+                paths.push_back(argument);
+            }
+        }
+        if (paths.size() != 3) {
+            std::cerr << "Usage: embedframes [--size <width> <height>] [--keyframes <interval>] [--levels <scales>]"
+                << " <frames path> <archive> <source>" << std::endl;
+            return 1;
+        }
+        settings.framesPath = paths[0];
+        settings.archivePath = paths[1];
+        settings.sourcePath = paths[2];
+
+        // The build prints one line for the whole archive, not one per frame
+        std::unique_ptr<BMPFrameSource> frames(settings.width > 0
+            ? new BMPFrameSource(settings.width, settings.height, settings.framesPath, false)
+            : new BMPFrameSource(settings.framesPath, false));
+        if (FrameArchive::Pack(*frames, settings.archivePath, settings.keyframeInterval, settings.levelScales) == 0) {
+            throw std::runtime_error("embedframes: found no frames at " + settings.framesPath);
+        }
+        std::vector<unsigned char> data = ReadFile(settings.archivePath);
+        WriteSource(data, settings);
+        std::cout << "BADAPPLE: embedded " << data.size() << " bytes of frames in " << settings.sourcePath << std::endl;
+        return 0;
+    }
+    catch (std::exception const& runtimeerror) {
+        std::cerr << "Exception: " << runtimeerror.what() << std::endl;
+        return 1;
+    }
+}
@@ -7,9 +7,49 @@
 #include <sstream>
 #include <vector>
 #include <limits>
+#include <memory>
 
 #include "traceinfo.h"
 #include "glmutils.h"
+#include "framesource.h"
+#include "framestore.h"
+#include "frameprefetcher.h"
+#include "framecodec.h"
+#include "framestream.h"
+#include "framearchive.h"
+#include "frametimings.h"
+#include "framecontour.h"
+#include "framecache.h"
+
+
+/**
+ * A dark pixel, in the same centered coordinates as the frame points. A quarter of the size of a glm::vec3,
+ * and drawn as is with glVertexAttribPointer(..., 2, GL_SHORT, GL_FALSE, ...). The z coordinate is always 0.
+ */
+struct FramePoint {
+	int16_t x;
+	int16_t y;
+};
+
+
+/**
+ * A horizontal run of dark pixels on one scanline, in the same centered coordinates as the frame points.
+ * xEnd is one past the last dark pixel of the run.
+ */
+struct FrameSpan {
+	float xBegin;
+	float xEnd;
+	float y;
+};
+
+
+/**
+ * The points of one frame in the points of a whole sequence of frames.
+ */
+struct FrameRange {
+	uint32_t first;
+	uint32_t count;
+};
 
 
 /**
@@ -27,7 +67,67 @@ public:
 	std::vector<glm::vec3> GenerateFramePoints();
 
 	/**
-	 * Read frame data from image at filepath and increment current frame ID.
+	 * Generate the points for the current frame into an existing vector, reusing its memory.
+	 * \param points - Receives one point per dark pixel.
+	 */
+	void GenerateFramePoints(std::vector<FramePoint>& points);
+
+	/**
+	 * Append the points of the current frame to the points already in a vector, so the frames of several
+	 * players can be drawn from one buffer.
+	 * \param points - Receives one point per dark pixel after the points it holds.
+	 * \param offset - Added to every point, e.g. to move the frame to its place in a grid of frames.
+	 */
+	void AppendFramePoints(std::vector<FramePoint>& points, glm::ivec2 offset);
+
+	/**
+	 * Generate the points of every frame of the source, one frame after the other, so a whole sequence
+	 * can be drawn from one vertex buffer. The current frame and the playback position do not change.
+	 * A runtime_error is thrown if the source can only be read once, like a stream.
+	 * \param points - Receives one point per dark pixel of every frame.
+	 * \param ranges - Receives the points of each frame; ranges[i] is the frame with ID i + 1.
+	 */
+	void GenerateSequencePoints(std::vector<FramePoint>& points, std::vector<FrameRange>& ranges);
+
+	/**
+	 * Generate the horizontal runs of dark pixels for the current frame.
+	 * A frame has far fewer runs than dark pixels, so they are cheaper to draw than points.
+	 * \param spans - Receives the runs, scanline by scanline from left to right.
+	 */
+	void GenerateFrameSpans(std::vector<FrameSpan>& spans);
+
+	/**
+	 * Generate triangles which cover the dark pixels of the current frame, see framecontour.h.
+	 * Their number grows with the corners of the outlines of the shapes, not with the resolution of the frame.
+	 * \param triangles - Receives three vertices per triangle, centered like the points of GenerateFramePoints().
+	 * \param tolerance - How far in pixels the simplified outlines may stray from the pixels.
+	 */
+	void GenerateFrameTriangles(std::vector<glm::vec2>& triangles, float tolerance = 0.5f);
+
+	/**
+	 * Generate the points of the pixels covered by the triangles of GenerateFrameTriangles(), rasterized on the CPU
+	 * with triangle_rasterizer, so what the simplification loses can be seen and drawn like the frame points.
+	 * \param points - Receives one point per covered pixel.
+	 * \param tolerance - How far in pixels the simplified outlines may stray from the pixels.
+	 */
+	void GenerateRasterizedPoints(std::vector<FramePoint>& points, float tolerance = 0.5f);
+
+	/**
+	 * Find the pixels which changed since the last call, so only those have to be uploaded.
+	 * The first call, and the first call after the frame source changes, compares against an all white frame.
+	 * \param runs - Receives the runs of changed pixels, as indices into the frame data.
+	 * \param mergeGap - Runs separated by fewer unchanged pixels than this are merged into one run.
+	 */
+	void GenerateChangedRuns(std::vector<PixelRun>& runs, unsigned int mergeGap = 16);
+
+	/**
+	 * \return The current frame, width * height bytes with one byte per pixel. UINT8_MAX is a white pixel.
+	 */
+	const unsigned char* GetFrameData() const;
+
+	/**
+	 * Read frame data from the frame source and increment current frame ID.
+	 * When prefetching, this takes the next loaded frame without blocking, and keeps the current frame if none is ready.
 	 */
 	void ReadFrameAndIncrement();
 
@@ -37,15 +137,171 @@ public:
 	 */
 	void SetFilepath(const std::string& filepath);
 
+	/**
+	 * Read frames from a memory mapped frame archive instead of bmp files.
+	 * A runtime_error is thrown if the archive can not be opened.
+	 * \param archivePath - The path to the archive.
+	 * \param level - The level of the archive to play, 0 is the largest.
+	 */
+	void OpenArchive(const std::string& archivePath, unsigned int level = 0);
+
+	/**
+	 * Read frames from a frame archive which is already in memory, e.g. compiled into the executable,
+	 * so no file is opened. The memory must outlive the player.
+	 * A runtime_error is thrown if the data is not a valid archive.
+	 * \param data - The archive, aligned to 8 bytes.
+	 * \param size - The size of the archive in bytes.
+	 * \param level - The level of the archive to play, 0 is the largest.
+	 */
+	void OpenEmbeddedArchive(const unsigned char* data, size_t size, unsigned int level = 0);
+
+	/**
+	 * Read frames from a raw frame stream, e.g. a pipe from a decoder, instead of bmp files.
+	 * Streams can only be read once, from the front, so Seek() refuses to jump in them. When the prefetcher
+	 * restarts, it loads the frames it dropped again from the frames the stream keeps, so the prefetch depth
+	 * must stay below StreamFrameSource::KeptFrames.
+	 * A runtime_error is thrown if the stream can not be opened.
+	 * \param streamPath - The path of the stream. "-" reads standard input.
+	 * \param width - The width of the frames.
+	 * \param height - The height of the frames.
+	 * \param format - The layout of the frames in the stream.
+	 */
+	void OpenStream(const std::string& streamPath, unsigned int width, unsigned int height, StreamFormat format);
+
+	/**
+	 * Switch to another level of the open archive. Playback continues at the current frame,
+	 * and the frame size changes to the size of the level.
+	 * \param level - The level to play, 0 is the largest.
+	 */
+	void SetLevel(unsigned int level);
+
+	/**
+	 * \return The level being played, 0 when reading bmp files.
+	 */
+	unsigned int GetLevel() const;
+
+	/**
+	 * \return The number of levels that can be played, 1 when reading bmp files.
+	 */
+	unsigned int GetLevelCount() const;
+
+	/**
+	 * \param level - The level, 0 is the largest.
+	 * \return The width and height of the frames of the level.
+	 */
+	glm::uvec2 GetLevelSize(unsigned int level) const;
+
 	void SetCurrentFrame(unsigned int frameID);
 
+	/**
+	 * Jump to a frame. The frame is read at once, from the nearest keyframe when reading an archive,
+	 * and the next call to ReadFrameAndIncrement() delivers it without waiting for the prefetcher.
+	 * Sources which can only be read once, like streams, can not be jumped in.
+	 * \param frameID - The frame to jump to. It is clamped to the frames of the source.
+	 * \return true if the frame was read, false if it could not be read or the source can not be jumped in.
+	 */
+	bool Seek(unsigned int frameID);
+
+	/**
+	 * \return The ID of the frame in GetFrameData(), 0 if no frame has been read.
+	 */
+	unsigned int GetFrameID() const;
+
+	/**
+	 * Equal frames have equal hashes, so a frame which repeats the frame before it, as many frames of Bad Apple do,
+	 * can be recognized without comparing the pixels, and what was generated for the frame before can be kept.
+	 * The hash is computed as the frame is read, by the loader thread when prefetching.
+	 * \return The HashFrame() of the frame in GetFrameData(), 0 if no frame has been read.
+	 */
+	uint64_t GetFrameHash() const;
+
+	/**
+	 * \return The number of frames of the source, 0 if it is not known.
+	 */
+	unsigned int GetFrameCount() const;
+
+	/**
+	 * Load frames ahead on a background thread.
+	 * \param depth - The number of frames to load ahead. 0 reads frames on the calling thread.
+	 */
+	void EnablePrefetch(unsigned int depth);
+
+	/**
+	 * \return The counters of the prefetcher. All zero if prefetching is disabled.
+	 */
+	PrefetchStats GetPrefetchStats() const;
+
+	/**
+	 * \return The counters of the store which holds the frame buffers.
+	 */
+	FrameStoreStats GetFrameStoreStats() const;
+
+	/**
+	 * Keep the most recently read frames in memory, so looping or seeking back does not read or decode them
+	 * from the frame source again. The cached frames are dropped when the frame source or the level changes.
+	 * \param budget - The most bytes of frames to keep. 0, the default, disables the cache.
+	 */
+	void SetFrameCacheBudget(size_t budget);
+
+	/**
+	 * \return The counters of the frame cache, kept across changes of the frame source.
+	 */
+	FrameCacheStats GetFrameCacheStats() const;
+
+	/**
+	 * The time spent reading frames from the source is recorded as FrameStage::Decode, on whichever thread reads them.
+	 * \return The timings of the stages of the frames, where the player records the stages it runs.
+	 */
+	FrameTimings& GetFrameTimings();
+
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+
 private:
-	unsigned char* ReadBMP(unsigned int frameID);
+	void SetSource(FrameSource* source);
+	void SetArchiveSource(ArchiveFrameSource* archiveSource, unsigned int level);
+	void AppendFramePoints(const unsigned char* frame, std::vector<FramePoint>& points,
+		glm::ivec2 offset = glm::ivec2(0));
 
 	unsigned int width;
 	unsigned int height;
 	std::string filepath;
 
+	// The open archive and the size of each of its levels, empty when reading bmp files.
+	// An archive in memory has no path.
+	std::string archivePath;
+	const unsigned char* embeddedArchive;
+	size_t embeddedArchiveSize;
+	std::vector<glm::uvec2> levelSizes;
+	unsigned int level;
+
+	// Declared before the prefetcher, which records into it until it is destroyed
+	FrameTimings timings;
+	// Declared before the source, which reads through it
+	FrameCache cache;
+
+	// The store is declared first, so every buffer is given back before it is destroyed
+	std::unique_ptr<FrameStore> store;
+	std::unique_ptr<FrameSource> source;
+	std::unique_ptr<FramePrefetcher> prefetcher;
+	unsigned int prefetchDepth;
+
 	unsigned int currentFrameID;
-	unsigned char* currentFrameData;
-};
\ No newline at end of file
+	FrameBuffer currentFrameData;
+	bool frameLoaded;
+	unsigned int loadedFrameID;
+	uint64_t frameHash;
+	// A frame read by Seek() which has not been delivered yet
+	bool seekPending;
+
+	// The frame as of the last call to GenerateChangedRuns()
+	FrameBuffer changedBaseData;
+
+	std::vector<uint16_t> rowPositions;
+
+	// Reused by GenerateFrameTriangles() and GenerateRasterizedPoints()
+	FrameContours contours;
+	FrameContours simplifiedContours;
+	std::vector<glm::vec2> rasterTriangles;
+	std::vector<unsigned char> rasterizedFrame;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file bmpfile.h
+ * Reading and writing of uncompressed bmp files as frames of one byte per pixel.
+ *
+ * 1, 8, 24 and 32 bit files are read. Indexed files are looked up in their palette, and every pixel is
+ * converted to its gray value. Frames are returned bottom row first, whatever the order of the rows in the file.
+ * Frames are written as 1 or 8 bit grayscale files, which are 24 and 3 times smaller than 24 bit files.
+ */
+
+/**
+ * The fields of a bmp header which are needed to read its pixels.
+ */
+struct BMPHeader {
+	unsigned int width;
+	unsigned int height;
+	unsigned int bitsPerPixel;      // 1, 8, 24 or 32
+	bool topDown;                   // true if the first row in the file is the top row
+	uint32_t dataOffset;            // Offset of the first row from the start of the file (bfOffBits)
+	uint32_t rowStride;             // Size of a row in bytes, including the padding to 4 bytes
+	unsigned char palette[256];     // The gray value of each palette entry of an indexed file
+};
+
+/**
+ * Parse and validate the header of a bmp file.
+ * A runtime_error is thrown if the file is not a bmp file this reader supports, or if it is truncated.
+ * \param data - The contents of the file.
+ * \param size - The size of the file in bytes.
+ * \return The parsed header.
+ */
+BMPHeader ParseBMPHeader(const unsigned char* data, size_t size);
+
+/**
+ * Convert the pixels of a bmp file to one gray byte per pixel.
+ * \param header - The header returned by ParseBMPHeader() for the same data.
+ * \param data - The contents of the file.
+ * \param pixels - A buffer of width * height bytes which receives the pixels, bottom row first.
+ */
+void DecodeBMPPixels(const BMPHeader& header, const unsigned char* data, unsigned char* pixels);
+
+/**
+ * Read a whole file into memory.
+ * A runtime_error is thrown if the file can be opened but not read.
+ * \param filepath - The path of the file.
+ * \param contents - Receives the contents of the file. Its capacity is reused from call to call.
+ * \return true if the file was read, false if it could not be opened. errno tells why.
+ */
+bool ReadBMPFile(const std::string& filepath, std::vector<unsigned char>& contents);
+
+/**
+ * Write a frame as a grayscale bmp file.
+ * A runtime_error is thrown if the file cannot be written.
+ * \param filepath - The path of the file.
+ * \param width - The width of the frame.
+ * \param height - The height of the frame.
+ * \param pixels - The frame, one byte per pixel, bottom row first.
+ * \param bitsPerPixel - 8 to write every byte of the frame as its gray value, or 1 to write only whether each pixel
+ *                       is white (UINT8_MAX) or dark.
+ */
+void WriteBMP(const std::string& filepath, unsigned int width, unsigned int height, const unsigned char* pixels, unsigned int bitsPerPixel);
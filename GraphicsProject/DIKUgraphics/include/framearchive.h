@@ -0,0 +1,340 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "framesource.h"
+#include "framecodec.h"
+
+
+/**
+ * \file framearchive.h
+ * A packed archive holding a whole Bad Apple frame sequence in one file.
+ *
+ * Layout (all values little-endian):
+ * \verbatim
+    FrameArchiveHeader                         - 32 bytes at offset 0
+    uint32_t levelCount, uint32_t reserved     - at offset 32, version 3 and later
+    FrameLevelEntry[levelCount]                - at offset 40, version 3 and later
+    frame payloads                             - one after the other
+    FrameIndexEntry[frameCount]                - one index per level, at the indexOffset of the level
+\endverbatim
+ * An archive may hold the sequence at several resolutions, a pyramid of levels where level 0 is the largest.
+ * Every level has the same frames. The header describes level 0; archives before version 3 have only that level.
+ * How a frame payload is encoded is given by the flags of its index entry, see FrameEncoding.
+ * Delta frames can only be decoded on top of the previous frame, so decoding starts at the nearest keyframe.
+ * Equal frames may share one payload, so several index entries of a level can point at the same offset.
+ */
+
+/**
+ * How a frame payload is encoded, stored in FrameIndexEntry::flags.
+ */
+enum FrameEncoding : uint32_t {
+	FrameEncodingBits = 0,      // 1 bit per pixel, most significant bit first, in the pixel order of FrameSource. A set bit is a dark pixel.
+	FrameEncodingKeyframe = 1,  // Runs of dark pixels on a white frame, see framecodec.h
+	FrameEncodingDelta = 2      // Runs of pixels toggled from the previous frame, see framecodec.h
+};
+
+/**
+ * The header at the start of a frame archive.
+ */
+struct FrameArchiveHeader {
+	char magic[4];          // "BAPL"
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameCount;
+	uint32_t firstFrameID;  // The frame ID of the first frame in the archive
+	uint64_t indexOffset;   // Offset of the frame index from the start of the file
+};
+
+/**
+ * An entry in the level table of a frame archive.
+ */
+struct FrameLevelEntry {
+	uint32_t width;
+	uint32_t height;
+	uint64_t indexOffset;   // Offset of the frame index of the level from the start of the file
+};
+
+/**
+ * An entry in the frame index of a frame archive.
+ */
+struct FrameIndexEntry {
+	uint64_t offset;        // Offset of the frame payload from the start of the file
+	uint32_t size;          // Size of the frame payload in bytes
+	uint32_t flags;
+};
+
+
+/**
+ * \class FrameArchive
+ * A read-only frame archive which is memory mapped once and indexed by frame.
+ */
+class FrameArchive {
+public:
+	/**
+	 * Memory map the archive at filepath.
+	 * A runtime_error is thrown if the file can not be mapped or is not a valid archive.
+	 * \param filepath - The path to the archive.
+	 * \param level - The level the frames are read from. 0 is the largest.
+	 */
+	FrameArchive(const std::string& filepath, unsigned int level = 0);
+
+	/**
+	 * Read an archive which is already in memory, e.g. compiled into the executable. Nothing is copied,
+	 * so the memory must outlive the archive.
+	 * A runtime_error is thrown if the data is not a valid archive.
+	 * \param data - The archive, aligned to 8 bytes like the start of a mapped file.
+	 * \param size - The size of the archive in bytes.
+	 * \param level - The level the frames are read from. 0 is the largest.
+	 */
+	FrameArchive(const unsigned char* data, size_t size, unsigned int level = 0);
+
+	~FrameArchive();
+
+	FrameArchive(const FrameArchive&) = delete;
+	FrameArchive& operator=(const FrameArchive&) = delete;
+
+	/**
+	 * \return The width of the frames of the level being read.
+	 */
+	unsigned int Width() const;
+
+	/**
+	 * \return The height of the frames of the level being read.
+	 */
+	unsigned int Height() const;
+
+	unsigned int FrameCount() const;
+	unsigned int FirstFrameID() const;
+
+	/**
+	 * \return The number of levels in the archive, at least 1.
+	 */
+	unsigned int LevelCount() const;
+
+	/**
+	 * \return The level the frames are read from.
+	 */
+	unsigned int Level() const;
+
+	/**
+	 * \param level - The level, 0 is the largest.
+	 * \return The width and height of the frames of the level.
+	 */
+	const FrameLevelEntry& LevelSize(unsigned int level) const;
+
+	/**
+	 * Get the packed payload of a frame.
+	 * \param index - The index of the frame in the archive, starting at 0.
+	 * \param size - Receives the size of the payload in bytes.
+	 * \return A pointer into the mapped archive.
+	 */
+	const unsigned char* FramePayload(unsigned int index, uint32_t& size) const;
+
+	/**
+	 * \param index - The index of the frame in the archive, starting at 0.
+	 * \return How the frame is encoded.
+	 */
+	FrameEncoding Encoding(unsigned int index) const;
+
+	/**
+	 * \param index - The index of the frame in the archive, starting at 0.
+	 * \return true if the frame can be decoded without the previous frame.
+	 */
+	bool IsKeyframe(unsigned int index) const;
+
+	/**
+	 * Find the keyframe that decoding of a frame has to start from, in constant time.
+	 * \param index - The index of the frame in the archive, starting at 0.
+	 * \return The index of the nearest keyframe at or before index.
+	 */
+	unsigned int KeyframeIndex(unsigned int index) const;
+
+	/**
+	 * Decode a single frame into one byte per pixel.
+	 * \param index - The index of the frame in the archive, starting at 0.
+	 * \param pixels - A buffer of Width() * Height() bytes. For a delta frame it must hold the previous frame,
+	 *                 and only the changed pixels are written.
+	 * \param changed - If not nullptr, the runs of changed pixels are appended to it.
+	 *                  A keyframe is reported as one run covering the whole frame.
+	 */
+	void DecodeFrame(unsigned int index, unsigned char* pixels, std::vector<PixelRun>* changed = nullptr) const;
+
+	/**
+	 * Check whether the file at filepath starts with a frame archive header.
+	 * \param filepath - The path to the file.
+	 */
+	static bool IsArchive(const std::string& filepath);
+
+	/**
+	 * Pack all frames of a frame source into an archive. Frames are read from frame ID 1
+	 * until the source has no more frames.
+	 * \param source - The frames to pack.
+	 * \param filepath - The path of the archive to write.
+	 * \param keyframeInterval - The maximum distance between keyframes. See FrameArchiveWriter.
+	 * \param levelScales - The levels of the archive. See FrameArchiveWriter.
+	 * \return The number of frames in the archive.
+	 */
+	static unsigned int Pack(FrameSource& source, const std::string& filepath, unsigned int keyframeInterval = DefaultKeyframeInterval,
+		const std::vector<unsigned int>& levelScales = std::vector<unsigned int>(1, 1));
+
+	static const uint32_t Version = 3;
+
+	/**
+	 * The default distance between keyframes when packing archives.
+	 */
+	static const unsigned int DefaultKeyframeInterval = 64;
+
+private:
+	void Open(const std::string& filepath);
+	void Map(const std::string& filepath);
+	void Unmap();
+	void ReadLevels(const std::string& filepath);
+	void Validate(const std::string& filepath) const;
+
+	const unsigned char* mapping;
+	size_t mappingSize;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	const FrameArchiveHeader* header;
+	std::vector<FrameLevelEntry> levels;
+	unsigned int level;
+	const FrameIndexEntry* index;
+
+	// The nearest keyframe at or before each frame of the level being read
+	std::vector<uint32_t> keyframes;
+};
+
+
+/**
+ * \class FrameArchiveWriter
+ * Writes a frame archive one frame at a time. The frame indices are written when the writer is closed.
+ * Each frame is stored in the smallest of the encodings it is allowed to use. A frame which is equal to an earlier
+ * keyframe of its level is not stored again; it becomes a keyframe which shares the payload of the earlier one,
+ * unless it is equal to the frame before it, which costs nothing as an empty delta.
+ * The smaller levels are downsampled from the frames as they are added: a pixel is dark if at least
+ * half of the pixels it covers are dark.
+ */
+class FrameArchiveWriter {
+public:
+	/**
+	 * Create the archive at filepath.
+	 * A runtime_error is thrown if the file can not be created.
+	 * \param filepath - The path of the archive to write.
+	 * \param width - The width of the frames.
+	 * \param height - The height of the frames.
+	 * \param firstFrameID - The frame ID of the first frame written.
+	 * \param keyframeInterval - The maximum distance between keyframes. 0 stores every frame as plain bits.
+	 * \param levelScales - One entry per level, largest first, which divides width and height for that level.
+	 *                      { 1, 2, 4 } stores the frames at full, half and quarter size.
+	 */
+	FrameArchiveWriter(const std::string& filepath, unsigned int width, unsigned int height, unsigned int firstFrameID = 1,
+		unsigned int keyframeInterval = FrameArchive::DefaultKeyframeInterval,
+		const std::vector<unsigned int>& levelScales = std::vector<unsigned int>(1, 1));
+
+	~FrameArchiveWriter();
+
+	FrameArchiveWriter(const FrameArchiveWriter&) = delete;
+	FrameArchiveWriter& operator=(const FrameArchiveWriter&) = delete;
+
+	/**
+	 * Append a frame to every level of the archive.
+	 * \param pixels - Width * height bytes, one per pixel, at the size given to the constructor.
+	 */
+	void AddFrame(const unsigned char* pixels);
+
+	/**
+	 * Write the frame index and header and close the file.
+	 */
+	void Close();
+
+	unsigned int FrameCount() const;
+
+	/**
+	 * \return The number of frames, over all levels, which share the payload of an earlier equal frame.
+	 */
+	unsigned int SharedFrames() const;
+
+private:
+	struct KeyframePayload {
+		FrameIndexEntry entry;
+		std::vector<unsigned char> packed;      // The packed bits of the frame, to tell it from others with its hash
+	};
+
+	struct Level {
+		unsigned int width;
+		unsigned int height;
+		uint64_t indexOffset;
+		std::vector<FrameIndexEntry> entries;
+		unsigned int framesSinceKeyframe;
+		std::vector<unsigned char> pixels;      // The downsampled frame
+		std::vector<unsigned char> previous;
+		// The keyframes of the level by the hash of their packed bits
+		std::unordered_map<uint64_t, KeyframePayload> keyframePayloads;
+	};
+
+	void AddLevelFrame(Level& level, const unsigned char* pixels);
+	void WriteHeader();
+	void Write(const void* data, size_t size);
+
+	FILE* file;
+	std::string filepath;
+	FrameArchiveHeader header;
+	unsigned int frameWidth;
+	unsigned int frameHeight;
+	std::vector<Level> levels;
+	uint64_t offset;
+	unsigned int sharedFrames;
+
+	unsigned int keyframeInterval;
+	std::vector<unsigned char> packed;
+	std::vector<unsigned char> keyframeRuns;
+	std::vector<unsigned char> deltaRuns;
+};
+
+
+/**
+ * \class ArchiveFrameSource
+ * A frame source which reads frames from a memory mapped frame archive.
+ * Reading the frame after the one read last only applies the changed pixels, until Reset() is called.
+ */
+class ArchiveFrameSource : public FrameSource {
+public:
+	/**
+	 * \param filepath - The path to the archive.
+	 * \param level - The level of the archive the frames are read from.
+	 */
+	ArchiveFrameSource(const std::string& filepath, unsigned int level = 0);
+
+	/**
+	 * \param data - An archive in memory, which must outlive the source. See FrameArchive.
+	 * \param size - The size of the archive in bytes.
+	 * \param level - The level of the archive the frames are read from.
+	 */
+	ArchiveFrameSource(const unsigned char* data, size_t size, unsigned int level = 0);
+
+	const FrameArchive& Archive() const;
+
+	unsigned int Width() const override;
+	unsigned int Height() const override;
+	unsigned int FrameCount() const override;
+	bool ReadFrame(unsigned int frameID, unsigned char* pixels) override;
+	void Reset() override;
+
+private:
+	FrameArchive archive;
+	// The frame the buffer of the next read holds, 0 if none
+	unsigned int lastFrameID;
+};
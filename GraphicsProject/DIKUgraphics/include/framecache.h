@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "framesource.h"
+#include "framestore.h"
+
+
+/**
+ * Counters of a FrameCache.
+ */
+struct FrameCacheStats {
+	uint64_t hits;              // Reads served from the cache
+	uint64_t misses;            // Reads which had to go to the frame source
+	uint64_t evictions;         // Frames dropped to stay within the budget
+	unsigned int frames;        // Frames in the cache
+	size_t bytes;               // Bytes of the frames in the cache
+	size_t budget;              // The most bytes of frames the cache keeps
+};
+
+
+/**
+ * \class FrameCache
+ * Decoded frames by frame ID, up to a budget of bytes. When the budget is reached, the least recently read frame
+ * is dropped and its buffer reused. The frames are kept in buffers from a FrameStore of their own.
+ * Frames may be read and inserted from different threads.
+ */
+class FrameCache {
+public:
+	/**
+	 * \param budget - The most bytes of frames to keep. A budget smaller than a frame keeps nothing.
+	 */
+	FrameCache(size_t budget = 0);
+
+	FrameCache(const FrameCache&) = delete;
+	FrameCache& operator=(const FrameCache&) = delete;
+
+	/**
+	 * Copy a frame out of the cache, and make it the most recently read frame.
+	 * \param frameID - The ID of the frame.
+	 * \param pixels - A buffer of FrameSize() bytes which receives the frame.
+	 * \return true if the frame was in the cache.
+	 */
+	bool Read(unsigned int frameID, unsigned char* pixels);
+
+	/**
+	 * Copy a frame into the cache as the most recently read frame, dropping the least recently read frames
+	 * as needed to stay within the budget.
+	 * \param frameID - The ID of the frame.
+	 * \param pixels - FrameSize() bytes of the frame.
+	 */
+	void Insert(unsigned int frameID, const unsigned char* pixels);
+
+	/**
+	 * Drop every frame, e.g. because the frames come from another source now. The counters are kept.
+	 * \param frameSize - The size of the frames from now on, in bytes.
+	 */
+	void Clear(size_t frameSize);
+
+	/**
+	 * Change the budget. Frames are dropped at once if the cache holds more than the new budget.
+	 * \param budget - The most bytes of frames to keep. A budget smaller than a frame keeps nothing.
+	 */
+	void SetBudget(size_t budget);
+
+	/**
+	 * \return true if the budget holds at least one frame.
+	 */
+	bool Enabled() const;
+
+	size_t FrameSize() const;
+
+	FrameCacheStats Stats() const;
+
+private:
+	struct Entry {
+		unsigned int frameID;
+		FrameBuffer pixels;
+	};
+
+	void Evict(size_t frames);
+	size_t MaxFrames() const;
+
+	mutable std::mutex mutex;
+	size_t budget;
+	size_t frameSize;
+	// Declared before the entries, which give their buffers back to it when they are dropped
+	std::unique_ptr<FrameStore> store;
+	// The most recently read frame first
+	std::list<Entry> entries;
+	std::unordered_map<unsigned int, std::list<Entry>::iterator> lookup;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+
+/**
+ * \class CachedFrameSource
+ * A frame source which reads frames through a FrameCache, so looping or seeking back does not read
+ * or decode them from the source again.
+ * Frames are read from the source into a buffer of its own, which nothing else touches, so sources which decode
+ * incrementally still find the frame they delivered last when a frame is not in the cache. While the cache is
+ * disabled, frames are read straight into the buffer of the caller.
+ */
+class CachedFrameSource : public FrameSource {
+public:
+	/**
+	 * The frames in the cache are dropped, since they are not frames of this source.
+	 * \param source - The source to read frames from. It is owned and deleted by the cached source.
+	 * \param cache - The cache, which must outlive the cached source.
+	 */
+	CachedFrameSource(FrameSource* source, FrameCache& cache);
+
+	/**
+	 * \return The source the frames are read from.
+	 */
+	FrameSource& Source();
+
+	unsigned int Width() const override;
+	unsigned int Height() const override;
+	unsigned int FrameCount() const override;
+	bool Seekable() const override;
+	bool ReadFrame(unsigned int frameID, unsigned char* pixels) override;
+	void Interrupt(bool interrupted) override;
+	void Reset() override;
+
+private:
+	std::unique_ptr<FrameSource> source;
+	FrameCache& cache;
+	std::vector<unsigned char> decoded;
+	// true if the source read into decoded last, false if it read into the buffer of the caller
+	bool readDecoded;
+};
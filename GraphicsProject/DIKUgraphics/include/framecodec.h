@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+/**
+ * \file framecodec.h
+ * A run-length codec for the difference between two frames.
+ *
+ * A payload is a sequence of pairs of LEB128 varints (skip, length): skip pixels are unchanged,
+ * then length pixels are toggled between dark and white. Runs are in pixel order and a payload
+ * of no runs means that nothing changed. A keyframe is encoded as the difference from an all white frame.
+ */
+
+/**
+ * A run of pixels in a frame.
+ */
+struct PixelRun {
+	uint32_t begin;     // Index of the first pixel in the run
+	uint32_t length;    // Number of pixels in the run
+};
+
+/**
+ * Encode the pixels which differ between two frames.
+ * \param previous - The previous frame, or nullptr to encode a keyframe.
+ * \param current - The frame to encode.
+ * \param size - The number of pixels in a frame.
+ * \param payload - Receives the encoded runs.
+ */
+void EncodeFrameDelta(const unsigned char* previous, const unsigned char* current, unsigned int size, std::vector<unsigned char>& payload);
+
+/**
+ * Apply encoded runs to a frame in place. Only the changed pixels are touched.
+ * A runtime_error is thrown if the payload is malformed.
+ * \param payload - The encoded runs.
+ * \param payloadSize - The size of the payload in bytes.
+ * \param pixels - The previous frame, which becomes the decoded frame. Clear it to white before applying a keyframe.
+ * \param size - The number of pixels in a frame.
+ * \param changed - If not nullptr, the runs of changed pixels are appended to it.
+ */
+void ApplyFrameDelta(const unsigned char* payload, size_t payloadSize, unsigned char* pixels, unsigned int size, std::vector<PixelRun>* changed = nullptr);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * \file framecontour.h
+ * Vectorization of frames: the outlines of the dark regions are traced with marching squares,
+ * simplified with Douglas-Peucker and the regions are triangulated, so a frame can be drawn with a number
+ * of triangles which grows with the complexity of its shapes instead of with its resolution.
+ *
+ * Coordinates are in pixels of the frame, where pixel (x, y) has its center at (x, y) and row 0 is the bottom row.
+ * The traced outlines pass halfway between a dark and a white pixel, so their vertices lie on a grid of half pixels.
+ */
+
+/**
+ * Closed polygons stored one after the other. Polygon i has the vertices from ends[i - 1], or 0 for the first,
+ * up to ends[i]. The last vertex of a polygon connects to its first.
+ * Outlines of dark regions run counter-clockwise and outlines of holes clockwise, so the dark side is on the left.
+ */
+struct FrameContours {
+	std::vector<glm::vec2> vertices;
+	std::vector<uint32_t> ends;
+
+	void Clear();
+};
+
+/**
+ * Trace the outlines of the dark pixels of a frame, the pixels which are not UINT8_MAX, with marching squares.
+ * The frame is surrounded by white, so every outline is closed. Dark pixels which only touch at a corner
+ * are joined in one outline.
+ * \param pixels - The frame, width * height bytes with one byte per pixel.
+ * \param width - The width of the frame.
+ * \param height - The height of the frame.
+ * \param contours - Receives the outlines, one vertex per pixel edge they cross.
+ */
+void TraceContours(const unsigned char* pixels, unsigned int width, unsigned int height, FrameContours& contours);
+
+/**
+ * Simplify closed polygons with the Douglas-Peucker algorithm.
+ * Polygons which are reduced to fewer than 3 vertices, like the outline of a lone pixel, are dropped.
+ * \param contours - The polygons to simplify.
+ * \param tolerance - The largest distance in pixels between a removed vertex and the simplified polygon.
+ * \param simplified - Receives the simplified polygons. It must not be contours.
+ */
+void SimplifyContours(const FrameContours& contours, float tolerance, FrameContours& simplified);
+
+/**
+ * Triangulate the regions enclosed by closed polygons with the even-odd rule, so holes stay open.
+ * The regions are cut into trapezoids at the heights of the vertices, and each trapezoid into two triangles;
+ * trapezoids between the same two edges are merged across heights.
+ * \param contours - The polygons.
+ * \param triangles - Receives three vertices per triangle, counter-clockwise.
+ */
+void TriangulateContours(const FrameContours& contours, std::vector<glm::vec2>& triangles);
+
+/**
+ * Draw triangles into a frame on the CPU with triangle_rasterizer, so it can be compared with the frame
+ * they were traced from. The triangles are rasterized at twice the resolution of the frame, where their
+ * vertices fall on whole pixels, and a pixel of the frame is dark if its center is covered.
+ * \param triangles - Three vertices per triangle, in the coordinates of TraceContours().
+ * \param width - The width of the frame.
+ * \param height - The height of the frame.
+ * \param pixels - A buffer of width * height bytes which receives the frame. Covered pixels are 0, the rest UINT8_MAX.
+ */
+void RasterizeTriangles(const std::vector<glm::vec2>& triangles, unsigned int width, unsigned int height, unsigned char* pixels);
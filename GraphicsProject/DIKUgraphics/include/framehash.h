@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * \file framehash.h
+ * A fast 64 bit hash of frame data, used to find frames which are equal without comparing their pixels.
+ * Bad Apple has long runs of equal frames, and all white and all dark frames recur throughout the video.
+ * Two frames with different pixels get the same hash with a probability of about 2^-64.
+ */
+
+/**
+ * Hash the bytes of a frame, or of any other data.
+ * \param data - The bytes to hash.
+ * \param size - The number of bytes. It is part of the hash, so frames of different sizes do not collide.
+ * \return The hash, never 0, so 0 can stand for no frame.
+ */
+uint64_t HashFrame(const unsigned char* data, size_t size);
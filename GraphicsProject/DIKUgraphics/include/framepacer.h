@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+
+/**
+ * \class FramePacer
+ * Schedules frames at a fixed rate against an absolute clock. Frame n is due at start + n / fps, so the time spent
+ * on drawing and waiting does not add up to drift. The render loop asks how long it may sleep before the next frame
+ * is due, and reports each frame it starts; frames started late are counted.
+ */
+class FramePacer {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 * The clock starts at once, and the first frame is due at once.
+	 * \param fps - The number of frames per second.
+	 * \param lateMilliseconds - A frame started more than this after it was due is counted as late.
+	 */
+	FramePacer(double fps, double lateMilliseconds = 2.0);
+
+	/**
+	 * Restart the clock, e.g. after playback was paused. The next frame is due at once.
+	 */
+	void Restart();
+
+	/**
+	 * \return true if the next frame is due.
+	 */
+	bool Due() const;
+
+	/**
+	 * \return The time in seconds until the next frame is due, 0 if it is due.
+	 */
+	double SecondsUntilDue() const;
+
+	/**
+	 * Start the frame which is due, and schedule the next one. If the loop fell more than a whole frame behind,
+	 * the deadlines it missed are skipped, so it does not catch up with a burst of frames.
+	 * \return How late the frame was started, in milliseconds.
+	 */
+	double Advance();
+
+	uint64_t Frames() const;
+
+	/**
+	 * \return The number of frames started later than the late limit.
+	 */
+	uint64_t LateFrames() const;
+
+	/**
+	 * \return The number of deadlines skipped because the loop was more than a frame behind.
+	 */
+	uint64_t SkippedDeadlines() const;
+
+	/**
+	 * \return The latest any frame was started, in milliseconds.
+	 */
+	double MaxLateMilliseconds() const;
+
+private:
+	Clock::time_point Deadline(uint64_t frame) const;
+
+	double fps;
+	double lateMilliseconds;
+
+	Clock::time_point start;
+	// The number of the next frame, counted from start
+	uint64_t next;
+
+	uint64_t frames;
+	uint64_t lateFrames;
+	uint64_t skippedDeadlines;
+	double maxLateMilliseconds;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framesource.h"
+#include "framestore.h"
+#include "frametimings.h"
+
+
+/**
+ * Counters of a FramePrefetcher.
+ */
+struct PrefetchStats {
+	uint64_t framesLoaded;      // Frames decoded by the loader thread
+	uint64_t framesDelivered;   // Frames taken by Pop()
+	uint64_t underruns;         // Calls to Pop() which found no frame ready before the end of the source
+};
+
+
+/**
+ * \class FramePrefetcher
+ * Loads frames ahead of playback on a background thread.
+ * The loader thread is the only producer and the caller of Pop() the only consumer of a lock-free ring of frames.
+ * While the prefetcher is running, the frame source must not be used by anyone else.
+ */
+class FramePrefetcher {
+public:
+	/**
+	 * \param source - The source to load frames from.
+	 * \param store - The store the frame buffers are taken from. It needs capacity + 1 buffers.
+	 * \param capacity - The number of frames that are loaded ahead.
+	 * \param timings - If not null, the time of every read from the source is recorded as FrameStage::Decode.
+	 */
+	FramePrefetcher(FrameSource& source, FrameStore& store, unsigned int capacity, FrameTimings* timings = nullptr);
+
+	~FramePrefetcher();
+
+	FramePrefetcher(const FramePrefetcher&) = delete;
+	FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+
+	/**
+	 * Start loading frames. A running loader is stopped and the loaded frames are dropped first.
+	 * \param frameID - The ID of the first frame to load.
+	 */
+	void Start(unsigned int frameID);
+
+	/**
+	 * Stop the loader thread and drop the loaded frames. A read of the loader which waits for the source is interrupted,
+	 * see FrameSource::Interrupt().
+	 */
+	void Stop();
+
+	/**
+	 * Take the next frame if it has been loaded. Never blocks.
+	 * \param pixels - Receives the buffer holding the frame. The buffer it held, if any, is reused for loading.
+	 * \param frameID - Receives the ID of the frame.
+	 * \param hash - Receives the HashFrame() of the frame, which the loader thread computes.
+	 * \return true if a frame was taken, false if none was ready.
+	 */
+	bool Pop(FrameBuffer& pixels, unsigned int& frameID, uint64_t& hash);
+
+	/**
+	 * \return true if the loader has reached the end of the source and all loaded frames have been taken.
+	 */
+	bool Finished() const;
+
+	PrefetchStats Stats() const;
+
+private:
+	struct Slot {
+		FrameBuffer pixels;
+		unsigned int frameID;
+		uint64_t hash;
+	};
+
+	void Load(unsigned int frameID);
+
+	FrameSource& source;
+	FrameStore& store;
+	FrameTimings* timings;
+	std::vector<Slot> slots;
+
+	// Only the loader thread writes head and only the consumer writes tail
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+	std::atomic<bool> running;
+	std::atomic<bool> endOfSource;
+
+	std::atomic<uint64_t> framesLoaded;
+	std::atomic<uint64_t> framesDelivered;
+	std::atomic<uint64_t> underruns;
+
+	// Only used to let the loader sleep while the ring is full
+	std::mutex sleepMutex;
+	std::condition_variable wakeup;
+
+	// The frame the source read last. It is copied into a slot, since the source decodes the next frame on top of it.
+	FrameBuffer working;
+	std::thread loader;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+
+/**
+ * \file framereduce.h
+ * Conversion of full size video frames to small black and white frames in one pass.
+ * Scaling, the conversion to gray and the threshold are done together, so the frame is read once
+ * and no intermediate frames are written. The gray values are the same as for bmp files (see bmpfile.h).
+ * The AVX2 path is used when the library is compiled with AVX2 enabled (option BADAPPLE_AVX2),
+ * else the SSE2 path on x86, else a scalar loop.
+ */
+
+/**
+ * How the pixels of the smaller frame are sampled from the large frame.
+ */
+enum class ReduceFilter {
+	Nearest,    // One pixel of the large frame per pixel. Only the sampled rows are read.
+	Area        // The average of every pixel the smaller pixel covers. Smoother edges, but the whole frame is read.
+};
+
+/**
+ * Scale a frame of blue, green and red bytes down, and convert it to white (UINT8_MAX) and dark (0) pixels.
+ * A runtime_error is thrown if a size is zero.
+ * \param bgr - The frame, 3 bytes per pixel, top row first like video frames are decoded.
+ * \param width - The width of the frame.
+ * \param height - The height of the frame.
+ * \param stride - The distance between two rows of the frame in bytes.
+ * \param outWidth - The width of the smaller frame.
+ * \param outHeight - The height of the smaller frame.
+ * \param threshold - Pixels with a gray value above this are white.
+ * \param filter - How the pixels are sampled.
+ * \param pixels - A buffer of outWidth * outHeight bytes which receives the smaller frame, bottom row first like frames are read.
+ */
+void ReduceFrame(const unsigned char* bgr, unsigned int width, unsigned int height, size_t stride,
+	unsigned int outWidth, unsigned int outHeight, unsigned int threshold, ReduceFilter filter, unsigned char* pixels);
+
+/**
+ * \return The name of the instruction set the frame reduction was compiled for.
+ */
+const char* FrameReduceInstructionSet();
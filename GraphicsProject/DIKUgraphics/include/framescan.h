@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "framecodec.h"
+
+
+/**
+ * \file framescan.h
+ * Vectorized scanning of frames for dark and changed pixels.
+ * The AVX2 path is used when the library is compiled with AVX2 enabled (option BADAPPLE_AVX2),
+ * else the SSE2 path on x86, else a scalar loop.
+ */
+
+/**
+ * Find the dark pixels in a row of a frame, i.e. the pixels which are not UINT8_MAX.
+ * \param pixels - The pixels of the row.
+ * \param count - The number of pixels in the row. At most 65536.
+ * \param positions - A buffer of at least count entries which receives the positions of the dark pixels in order.
+ * \return The number of dark pixels found.
+ */
+unsigned int FindDarkPixels(const unsigned char* pixels, unsigned int count, uint16_t* positions);
+
+/**
+ * Find the runs of pixels which differ between two frames.
+ * \param previous - The previous frame.
+ * \param current - The current frame.
+ * \param count - The number of pixels in a frame.
+ * \param mergeGap - Runs separated by fewer unchanged pixels than this are merged into one run.
+ * \param runs - Receives the runs of changed pixels in order.
+ */
+void FindChangedRuns(const unsigned char* previous, const unsigned char* current, unsigned int count, unsigned int mergeGap, std::vector<PixelRun>& runs);
+
+/**
+ * \return The name of the instruction set the frame scanning was compiled for.
+ */
+const char* FrameScanInstructionSet();
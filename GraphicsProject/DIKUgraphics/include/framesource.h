@@ -0,0 +1,103 @@
+#pragma once
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class FrameSource
+ * An interface for anything that can deliver Bad Apple frames by frame ID.
+ * Frames are delivered as one byte per pixel, row by row, where UINT8_MAX is a white pixel
+ * and every other value is a dark pixel.
+ */
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+
+	/**
+	 * \return The width of the frames in pixels.
+	 */
+	virtual unsigned int Width() const = 0;
+
+	/**
+	 * \return The height of the frames in pixels.
+	 */
+	virtual unsigned int Height() const = 0;
+
+	/**
+	 * \return The number of frames in the source, or 0 if it is not known.
+	 */
+	virtual unsigned int FrameCount() const = 0;
+
+	/**
+	 * \return true if frames can be read in any order, false if the source can only go forwards, like a pipe.
+	 */
+	virtual bool Seekable() const { return true; }
+
+	/**
+	 * Read a frame into a pixel buffer.
+	 * Sources may decode incrementally on top of the frame they read last, so pass the same buffer unmodified
+	 * on every call, or call Reset() before passing another one.
+	 * \param frameID - The ID of the frame. The first frame has ID 1.
+	 * \param pixels - A buffer of Width() * Height() bytes which receives the frame.
+	 * \return true if the frame was read, false if there is no such frame.
+	 */
+	virtual bool ReadFrame(unsigned int frameID, unsigned char* pixels) = 0;
+
+	/**
+	 * Forget the frame read last, because the buffer of the next ReadFrame() does not hold it, e.g. after a seek
+	 * into another buffer. The next read decodes its frame without building on an earlier one.
+	 */
+	virtual void Reset() {}
+
+	/**
+	 * Make reads which wait for data, like reads from a pipe, return false at once while interrupted, so a thread
+	 * waiting in ReadFrame() can be stopped. The frame being read is continued by the next read after that.
+	 * Sources which never wait ignore it. It may be called from another thread than the one reading.
+	 * \param interrupted - true to interrupt reads, false to let them wait again.
+	 */
+	virtual void Interrupt(bool interrupted) {}
+};
+
+
+/**
+ * \class BMPFrameSource
+ * A frame source which reads every frame from its own numbered bmp file.
+ * The files may be 1, 8, 24 or 32 bits per pixel, bottom-up or top-down, but must all have the size of the frames.
+ * A missing file ends the frames; a file which cannot be read throws a runtime_error.
+ */
+class BMPFrameSource : public FrameSource {
+public:
+	/**
+	 * \param width - The width of the frames.
+	 * \param height - The height of the frames.
+	 * \param filepath - The general filepath to the images. "_<frame number>.bmp" will be added to this path.
+	 * \param verbose - If true, the path of every file is printed as it is opened. Packing turns it off.
+	 */
+	BMPFrameSource(unsigned int width, unsigned int height, std::string filepath, bool verbose = true);
+
+	/**
+	 * Frames of the size of the first frame.
+	 * A runtime_error is thrown if the first frame can not be read.
+	 * \param filepath - The general filepath to the images. "_<frame number>.bmp" will be added to this path.
+	 * \param verbose - If true, the path of every file is printed as it is opened. Packing turns it off.
+	 */
+	BMPFrameSource(std::string filepath, bool verbose = true);
+
+	unsigned int Width() const override;
+	unsigned int Height() const override;
+	unsigned int FrameCount() const override;
+	bool ReadFrame(unsigned int frameID, unsigned char* pixels) override;
+
+private:
+	bool ReadBMP(unsigned int frameID, unsigned char* pixels);
+
+	unsigned int width;
+	unsigned int height;
+	std::string filepath;
+	bool verbose;
+
+	std::vector<unsigned char> fileData;
+};
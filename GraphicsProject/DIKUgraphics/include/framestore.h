@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+class FrameStore;
+
+
+/**
+ * Counters of a FrameStore.
+ */
+struct FrameStoreStats {
+	uint64_t allocations;       // Buffers allocated from the heap
+	uint64_t acquires;          // Buffers handed out by Acquire()
+	uint64_t reuses;            // Acquires served by a returned buffer
+	unsigned int inUse;         // Buffers currently handed out
+	unsigned int peakInUse;     // The largest number of buffers handed out at the same time
+	size_t bytesAllocated;      // Bytes held by the store, handed out or not
+};
+
+
+/**
+ * \class FrameBuffer
+ * An owning handle to a frame buffer from a FrameStore. The buffer goes back to the store when the handle is destroyed.
+ * A handle can be moved and swapped, but not copied.
+ */
+class FrameBuffer {
+public:
+	/**
+	 * Create an empty handle.
+	 */
+	FrameBuffer();
+
+	~FrameBuffer();
+
+	FrameBuffer(FrameBuffer&& other) noexcept;
+	FrameBuffer& operator=(FrameBuffer&& other) noexcept;
+
+	FrameBuffer(const FrameBuffer&) = delete;
+	FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+	unsigned char* Data();
+	const unsigned char* Data() const;
+
+	/**
+	 * \return The size of the buffer in bytes, 0 for an empty handle.
+	 */
+	size_t Size() const;
+
+	/**
+	 * \return true if the handle holds a buffer.
+	 */
+	explicit operator bool() const;
+
+	unsigned char& operator[](size_t i);
+	const unsigned char& operator[](size_t i) const;
+
+	void swap(FrameBuffer& other);
+
+	/**
+	 * Give the buffer back to its store and leave the handle empty.
+	 */
+	void Release();
+
+private:
+	friend class FrameStore;
+	FrameBuffer(FrameStore* store, unsigned char* data);
+
+	FrameStore* store;
+	unsigned char* data;
+};
+
+
+/**
+ * \class FrameStore
+ * A pool of aligned frame buffers of a fixed size which are recycled instead of freed.
+ * Buffers may be acquired and released from different threads.
+ * The store must outlive every buffer acquired from it.
+ */
+class FrameStore {
+public:
+	/**
+	 * \param frameSize - The size of each buffer in bytes.
+	 * \param capacity - The number of buffers allocated up front.
+	 * \param alignment - The alignment of each buffer. Must be a power of two.
+	 */
+	FrameStore(size_t frameSize, unsigned int capacity, size_t alignment = DefaultAlignment);
+
+	~FrameStore();
+
+	FrameStore(const FrameStore&) = delete;
+	FrameStore& operator=(const FrameStore&) = delete;
+
+	/**
+	 * Take a buffer from the store. A new buffer is only allocated when all buffers are in use.
+	 * The contents of the buffer are undefined.
+	 */
+	FrameBuffer Acquire();
+
+	/**
+	 * Allocate buffers up front until the store holds at least capacity buffers.
+	 * \param capacity - The number of buffers the store should hold.
+	 */
+	void Reserve(unsigned int capacity);
+
+	size_t FrameSize() const;
+
+	FrameStoreStats Stats() const;
+
+	/**
+	 * The default alignment is a cache line, which is also enough for AVX loads.
+	 */
+	static const size_t DefaultAlignment = 64;
+
+private:
+	friend class FrameBuffer;
+	void Release(unsigned char* data);
+	unsigned char* Allocate();
+
+	size_t frameSize;
+	size_t alignment;
+
+	mutable std::mutex mutex;
+	std::vector<unsigned char*> buffers;
+	std::vector<unsigned char*> freeBuffers;
+	FrameStoreStats stats;
+};
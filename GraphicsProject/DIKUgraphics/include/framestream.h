@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "framesource.h"
+
+
+/**
+ * The layout of the frames in a raw frame stream. Every frame has the same size, and there is nothing between frames.
+ */
+enum class StreamFormat {
+	Gray8,      // One gray byte per pixel, like ffmpeg -pix_fmt gray. Pixels above the threshold are white.
+	Bits        // One bit per pixel, rows padded to whole bytes, the leftmost pixel in the most significant bit
+	            // and a set bit for white, like ffmpeg -pix_fmt monob.
+};
+
+
+/**
+ * \class StreamFrameSource
+ * A frame source which reads raw frames from a file descriptor, e.g. a pipe from a decoder process,
+ * so playback starts before the whole video is decoded.
+ *
+ * A stream is read once, from the front. Frames after the next frame are reached by reading and dropping the
+ * frames before them. Of the frames which have already been read, only the last KeptFrames can be read again, which
+ * lets a prefetcher that is restarted load the frames it dropped. The end of the stream ends
+ * the frames; a stream which ends in the middle of a frame, or which can not be read, throws a runtime_error.
+ * Reads block until the writer delivers a frame, or until they are interrupted. Reads of standard input and pipes
+ * can not be interrupted on Windows.
+ */
+class StreamFrameSource : public FrameSource {
+public:
+	// Gray values above this are white, the same as for the extractor
+	static constexpr unsigned int DefaultThreshold = 175;
+	// The number of frames read last which are kept, more than the frames a prefetcher loads ahead
+	static constexpr unsigned int KeptFrames = 64;
+
+	/**
+	 * Read frames from a file or a named pipe.
+	 * A runtime_error is thrown if it can not be opened.
+	 * \param filepath - The path of the stream. "-" reads standard input.
+	 * \param width - The width of the frames.
+	 * \param height - The height of the frames.
+	 * \param format - The layout of the frames.
+	 * \param topDown - true if the top row of a frame comes first, as decoders write them.
+	 * \param threshold - Gray values above this are white. Only used for StreamFormat::Gray8.
+	 */
+	StreamFrameSource(const std::string& filepath, unsigned int width, unsigned int height, StreamFormat format,
+		bool topDown = true, unsigned int threshold = DefaultThreshold);
+
+	/**
+	 * Read frames from an open file descriptor. The descriptor is not closed by the source.
+	 * \param fileDescriptor - The descriptor to read from.
+	 */
+	StreamFrameSource(int fileDescriptor, unsigned int width, unsigned int height, StreamFormat format,
+		bool topDown = true, unsigned int threshold = DefaultThreshold);
+
+	~StreamFrameSource();
+
+	StreamFrameSource(const StreamFrameSource&) = delete;
+	StreamFrameSource& operator=(const StreamFrameSource&) = delete;
+
+	unsigned int Width() const override;
+	unsigned int Height() const override;
+	unsigned int FrameCount() const override;
+	bool Seekable() const override;
+	bool ReadFrame(unsigned int frameID, unsigned char* pixels) override;
+	void Interrupt(bool interrupted) override;
+
+	/**
+	 * \return The size of one frame in the stream in bytes.
+	 */
+	size_t FrameBytes() const;
+
+private:
+	bool ReadRaw();
+	unsigned char* RawFrame(unsigned int frameID);
+	void Decode(const unsigned char* frame, unsigned char* pixels) const;
+
+	int fileDescriptor;
+	bool ownsDescriptor;
+	std::string name;
+
+	unsigned int width;
+	unsigned int height;
+	StreamFormat format;
+	bool topDown;
+	unsigned int threshold;
+	size_t rowBytes;
+
+	// The ID of the frame the stream is at
+	unsigned int nextFrameID;
+	// The frames read last, as they are in the stream, each at the index of its frame ID modulo KeptFrames
+	std::vector<unsigned char> raw;
+	// The bytes of the next frame which have been read into raw, when a read was interrupted in the middle of it
+	size_t rawFilled;
+	std::atomic<bool> interrupted;
+};
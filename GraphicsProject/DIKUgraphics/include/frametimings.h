@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * The stages a frame passes through on its way to the screen.
+ */
+enum class FrameStage {
+	Load,       // Taking the next frame from the prefetcher, or reading it when not prefetching
+	Decode,     // Reading and decoding a frame in the frame source, on the loader thread when prefetching
+	Points,     // Generating the points, runs or changed pixels of the frame
+	Upload,     // Sending the frame to OpenGL
+	Draw,       // Issuing the draw calls
+	Swap,       // Swapping the buffers, which waits for the GPU and the display
+	Count
+};
+
+
+/**
+ * The statistics of one stage. Times are in milliseconds; the percentiles are accurate to 1/8 of their value.
+ */
+struct StageStats {
+	uint64_t count;
+	double min;
+	double mean;
+	double p50;
+	double p99;
+	double max;
+};
+
+
+/**
+ * \class FrameTimings
+ * Collects the time spent in each stage of each frame into histograms with buckets that grow with the time,
+ * so recording is a handful of integer operations and the memory does not grow with the number of frames.
+ * Times can be recorded from any thread.
+ * The times of the OpenGL stages are the time the CPU spends in the calls; the GPU works on them later.
+ */
+class FrameTimings {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FrameTimings();
+
+	FrameTimings(const FrameTimings&) = delete;
+	FrameTimings& operator=(const FrameTimings&) = delete;
+
+	/**
+	 * Record the time a stage took for one frame.
+	 */
+	void Record(FrameStage stage, Clock::duration time);
+
+	/**
+	 * \return The statistics of a stage, all zero if it was not recorded.
+	 */
+	StageStats Stats(FrameStage stage) const;
+
+	/**
+	 * Write one line per stage: stage,count,min_ms,mean_ms,p50_ms,p99_ms,max_ms after a header line.
+	 */
+	void WriteCSV(std::ostream& out) const;
+
+	/**
+	 * Write the statistics to a CSV file.
+	 * A runtime_error is thrown if the file can not be written.
+	 */
+	void WriteCSV(const std::string& filepath) const;
+
+	/**
+	 * Forget every recorded time.
+	 */
+	void Reset();
+
+	static const char* StageName(FrameStage stage);
+
+private:
+	struct Histogram {
+		uint64_t count;
+		uint64_t sum;
+		uint64_t min;
+		uint64_t max;
+		std::vector<uint64_t> buckets;
+	};
+
+	static unsigned int Bucket(uint64_t nanoseconds);
+	static uint64_t BucketEnd(unsigned int bucket);
+	static double Percentile(const Histogram& histogram, double fraction);
+
+	mutable std::mutex mutex;
+	Histogram histograms[size_t(FrameStage::Count)];
+};
+
+
+/**
+ * \class StageTimer
+ * Records the time from its construction to its destruction as one frame of a stage.
+ */
+class StageTimer {
+public:
+	StageTimer(FrameTimings& timings, FrameStage stage);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	FrameTimings& timings;
+	FrameStage stage;
+	FrameTimings::Clock::time_point start;
+};
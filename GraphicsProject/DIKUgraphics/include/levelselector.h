@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * \class LevelSelector
+ * Picks the level of a frame pyramid to play from the size of the window and the time spent on each frame.
+ * Level 0 is the largest. After a run of frames over budget the selector downshifts to the next smaller level,
+ * and after a long run of frames well within budget it tries the next larger level again,
+ * but never a level larger than the window can show.
+ */
+class LevelSelector {
+public:
+	/**
+	 * \param levelCount - The number of levels, at least 1.
+	 * \param missesToDownshift - The number of frames over budget in a row before downshifting.
+	 * \param hitsToUpshift - The number of frames well within budget in a row before upshifting.
+	 */
+	LevelSelector(unsigned int levelCount, unsigned int missesToDownshift = 3, unsigned int hitsToUpshift = 120);
+
+	/**
+	 * Set the largest level the window can show. A smaller level than the current one is taken at once.
+	 * \param level - The largest level, 0 is the largest of the pyramid.
+	 */
+	void SetLargestLevel(unsigned int level);
+
+	/**
+	 * Report the time spent on a frame.
+	 * \param frameMilliseconds - The time spent on producing and drawing the frame.
+	 * \param budgetMilliseconds - The time a frame may take.
+	 * \return The level to play from the next frame on.
+	 */
+	unsigned int Update(double frameMilliseconds, double budgetMilliseconds);
+
+	unsigned int Level() const;
+
+	/**
+	 * \return The number of times the level was made smaller because frames missed their budget.
+	 */
+	uint64_t Downshifts() const;
+
+	/**
+	 * \return The number of times the level was made larger again.
+	 */
+	uint64_t Upshifts() const;
+
+	/**
+	 * A frame is well within budget if it takes less than this fraction of it, since a level twice as large
+	 * in each direction has four times the pixels.
+	 */
+	static constexpr double UpshiftFraction = 0.25;
+
+private:
+	unsigned int levelCount;
+	unsigned int missesToDownshift;
+	unsigned int hitsToUpshift;
+
+	unsigned int level;
+	unsigned int largestLevel;
+	unsigned int misses;
+	unsigned int hits;
+
+	uint64_t downshifts;
+	uint64_t upshifts;
+};
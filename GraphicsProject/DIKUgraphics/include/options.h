@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * \file options.h
+ * Reading the values of command line options, shared by the player, the extractor and the embedframes tool.
+ * A value which can not be read throws a runtime_error which names the option and the value.
+ */
+
+/**
+ * Read a whole number.
+ * \param text - The value given to the option.
+ * \param option - The option, like "--workers", for the error.
+ * \return The number.
+ */
+int ParseNumber(const std::string& text, const std::string& option);
+
+/**
+ * Read a decimal number, like 0.5.
+ * \param text - The value given to the option.
+ * \param option - The option, like "--scale", for the error.
+ * \return The number.
+ */
+double ParseDecimal(const std::string& text, const std::string& option);
+
+/**
+ * Read a comma separated list of level scales, like "1,2,5,10". Every scale must be at least 1.
+ * \param text - The value given to the option.
+ * \param option - The option, like "--levels", for the error.
+ * \return The scales in the order they were given.
+ */
+std::vector<unsigned int> ParseScales(const std::string& text, const std::string& option);
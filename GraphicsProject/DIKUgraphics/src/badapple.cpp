@@ -1,43 +1,234 @@
 #include "badapple.h"
+#include "framearchive.h"
+#include "framehash.h"
+#include "framescan.h"
+
+#include <cstring>
 
 BadApple::BadApple(unsigned int width, unsigned int height, std::string filepath)
     : width(width)
     , height(height)
     , filepath(filepath)
+    , embeddedArchive(nullptr)
+    , embeddedArchiveSize(0)
+    , level(0)
+    , prefetchDepth(0)
     , currentFrameID(1)
+    , frameLoaded(false)
+    , loadedFrameID(0)
+    , frameHash(0)
+    , seekPending(false)
 {
+    SetSource(new BMPFrameSource(width, height, filepath));
 }
 
-int mul = 3; // The pixels in the bmp files are 3 bytes
-
 std::vector<glm::vec3> BadApple::GenerateFramePoints()
 {
+    std::vector<FramePoint> framePoints;
+    GenerateFramePoints(framePoints);
+
     std::vector<glm::vec3> points;
+    points.reserve(framePoints.size());
+    for (const FramePoint& point : framePoints)
+    {
+        points.emplace_back(point.x, point.y, 0.0f);
+    }
+    return points;
+}
+
+void BadApple::GenerateFramePoints(std::vector<FramePoint>& points)
+{
+    points.clear();
+
+    if (!frameLoaded)
+    {
+        std::cout << "BADAPPLE: frame data not initialized." << std::endl;
+        return;
+    }
+
+    // Every pixel may be dark, so nothing is reallocated while the points are emitted
+    points.reserve(width * height);
+    AppendFramePoints(currentFrameData.Data(), points);
+}
 
-    if (currentFrameData == nullptr)
+void BadApple::AppendFramePoints(std::vector<FramePoint>& points, glm::ivec2 offset)
+{
+    if (!frameLoaded)
     {
         std::cout << "BADAPPLE: frame data not initialized." << std::endl;
-        return points;
+        return;
+    }
+
+    AppendFramePoints(currentFrameData.Data(), points, offset);
+}
+
+void BadApple::GenerateSequencePoints(std::vector<FramePoint>& points, std::vector<FrameRange>& ranges)
+{
+    points.clear();
+    ranges.clear();
+
+    if (!source->Seekable())
+    {
+        throw std::runtime_error("BadApple::GenerateSequencePoints(): the frame source can only be read once");
+    }
+
+    // The source is not in use while the prefetcher is stopped
+    if (prefetcher)
+    {
+        prefetcher->Stop();
+    }
+    try {
+        FrameBuffer frame = store->Acquire();
+        source->Reset();
+        for (unsigned int frameID = 1; source->ReadFrame(frameID, frame.Data()); frameID++)
+        {
+            FrameRange range;
+            range.first = uint32_t(points.size());
+            AppendFramePoints(frame.Data(), points);
+            range.count = uint32_t(points.size() - range.first);
+            ranges.push_back(range);
+        }
+        source->Reset();
+    }
+    catch (...) {
+        source->Reset();
+        if (prefetcher)
+        {
+            prefetcher->Start(currentFrameID);
+        }
+        throw;
+    }
+    if (prefetcher)
+    {
+        prefetcher->Start(currentFrameID);
+    }
+}
+
+void BadApple::GenerateFrameSpans(std::vector<FrameSpan>& spans)
+{
+    spans.clear();
+
+    if (!frameLoaded)
+    {
+        std::cout << "BADAPPLE: frame data not initialized." << std::endl;
+        return;
     }
 
     glm::ivec2 centering(width / 2, height / 2);
 
-    for (int y = 0; y < height; y++)
+    rowPositions.resize(width);
+
+    for (unsigned int y = 0; y < height; y++)
     {
-        for (int x = 0; x < width; x++) {
-            unsigned char thisPixel = currentFrameData[(y * width + x) * mul];
-            if (thisPixel != UINT8_MAX) {
-                points.push_back(glm::vec3(x-centering.x, y-centering.y, 0.0f));
+        unsigned int found = FindDarkPixels(currentFrameData.Data() + y * width, width, rowPositions.data());
+        unsigned int i = 0;
+        while (i < found) {
+            // Merge neighbouring dark pixels into one run
+            unsigned int begin = i;
+            while (i + 1 < found && rowPositions[i + 1] == rowPositions[i] + 1) {
+                i++;
             }
+            spans.push_back(FrameSpan{
+                float(int(rowPositions[begin]) - centering.x),
+                float(int(rowPositions[i]) + 1 - centering.x),
+                float(int(y) - centering.y) });
+            i++;
         }
     }
+}
 
-    return points;
+void BadApple::GenerateFrameTriangles(std::vector<glm::vec2>& triangles, float tolerance)
+{
+    triangles.clear();
+
+    if (!frameLoaded)
+    {
+        std::cout << "BADAPPLE: frame data not initialized." << std::endl;
+        return;
+    }
+
+    TraceContours(currentFrameData.Data(), width, height, contours);
+    SimplifyContours(contours, tolerance, simplifiedContours);
+    TriangulateContours(simplifiedContours, triangles);
+
+    glm::vec2 centering(float(width / 2), float(height / 2));
+    for (glm::vec2& vertex : triangles)
+    {
+        vertex -= centering;
+    }
+}
+
+void BadApple::GenerateRasterizedPoints(std::vector<FramePoint>& points, float tolerance)
+{
+    points.clear();
+
+    if (!frameLoaded)
+    {
+        std::cout << "BADAPPLE: frame data not initialized." << std::endl;
+        return;
+    }
+
+    // The triangles are rasterized in the coordinates of the frame, so they are not centered here
+    TraceContours(currentFrameData.Data(), width, height, contours);
+    SimplifyContours(contours, tolerance, simplifiedContours);
+    TriangulateContours(simplifiedContours, rasterTriangles);
+
+    rasterizedFrame.resize(width * height);
+    RasterizeTriangles(rasterTriangles, width, height, rasterizedFrame.data());
+
+    points.reserve(width * height);
+    AppendFramePoints(rasterizedFrame.data(), points);
+}
+
+void BadApple::GenerateChangedRuns(std::vector<PixelRun>& runs, unsigned int mergeGap)
+{
+    FindChangedRuns(changedBaseData.Data(), currentFrameData.Data(), width * height, mergeGap, runs);
+
+    // Only the changed pixels have to be copied to keep the base up to date
+    for (const PixelRun& run : runs)
+    {
+        memcpy(changedBaseData.Data() + run.begin, currentFrameData.Data() + run.begin, run.length);
+    }
+}
+
+const unsigned char* BadApple::GetFrameData() const
+{
+    return currentFrameData.Data();
 }
 
 void BadApple::ReadFrameAndIncrement()
 {
-    currentFrameData = ReadBMP(currentFrameID);
+    if (seekPending)
+    {
+        seekPending = false;
+        return;
+    }
+
+    if (prefetcher)
+    {
+        unsigned int frameID;
+        uint64_t hash;
+        if (prefetcher->Pop(currentFrameData, frameID, hash))
+        {
+            frameLoaded = true;
+            loadedFrameID = frameID;
+            frameHash = hash;
+            currentFrameID = frameID + 1;
+        }
+        return;
+    }
+
+    StageTimer timer(timings, FrameStage::Decode);
+    if (source->ReadFrame(currentFrameID, currentFrameData.Data()))
+    {
+        frameLoaded = true;
+        loadedFrameID = currentFrameID;
+        frameHash = HashFrame(currentFrameData.Data(), width * height);
+    }
+    else
+    {
+        std::cout << "BADAPPLE: could not read frame " << currentFrameID << std::endl;
+    }
     currentFrameID++;
 }
 
@@ -45,30 +236,262 @@ void BadApple::SetFilepath(const std::string& filepath)
 {
     std::cout << "Setting new filepath: " << filepath << std::endl;
     this->filepath = filepath;
+    archivePath.clear();
+    embeddedArchive = nullptr;
+    levelSizes.clear();
+    level = 0;
+    SetSource(new BMPFrameSource(width, height, filepath));
+}
+
+void BadApple::OpenArchive(const std::string& archivePath, unsigned int level)
+{
+    std::cout << "Opening frame archive: " << archivePath << " at level " << level << std::endl;
+    ArchiveFrameSource* archiveSource = new ArchiveFrameSource(archivePath, level);
+
+    this->archivePath = archivePath;
+    embeddedArchive = nullptr;
+    SetArchiveSource(archiveSource, level);
+}
+
+void BadApple::OpenEmbeddedArchive(const unsigned char* data, size_t size, unsigned int level)
+{
+    std::cout << "Opening embedded frame archive of " << size << " bytes at level " << level << std::endl;
+    ArchiveFrameSource* archiveSource = new ArchiveFrameSource(data, size, level);
+
+    archivePath.clear();
+    embeddedArchive = data;
+    embeddedArchiveSize = size;
+    SetArchiveSource(archiveSource, level);
+}
+
+void BadApple::OpenStream(const std::string& streamPath, unsigned int width, unsigned int height, StreamFormat format)
+{
+    std::cout << "Opening frame stream: " << streamPath << std::endl;
+    StreamFrameSource* streamSource = new StreamFrameSource(streamPath, width, height, format);
+
+    archivePath.clear();
+    embeddedArchive = nullptr;
+    levelSizes.clear();
+    level = 0;
+    SetSource(streamSource);
+}
+
+void BadApple::SetLevel(unsigned int level)
+{
+    if ((archivePath.empty() && embeddedArchive == nullptr) || level == this->level) return;
+    if (level >= levelSizes.size())
+    {
+        throw std::runtime_error("BadApple::SetLevel(): the archive has no level " + std::to_string(level));
+    }
+    // The archive is mapped again, which is cheap, and the prefetcher restarts at the current frame
+    if (embeddedArchive != nullptr)
+    {
+        OpenEmbeddedArchive(embeddedArchive, embeddedArchiveSize, level);
+    }
+    else
+    {
+        OpenArchive(archivePath, level);
+    }
+}
+
+unsigned int BadApple::GetLevel() const
+{
+    return level;
+}
+
+unsigned int BadApple::GetLevelCount() const
+{
+    return levelSizes.empty() ? 1 : static_cast<unsigned int>(levelSizes.size());
+}
+
+glm::uvec2 BadApple::GetLevelSize(unsigned int level) const
+{
+    if (levelSizes.empty())
+    {
+        return glm::uvec2(width, height);
+    }
+    return levelSizes.at(level);
 }
 
 void BadApple::SetCurrentFrame(unsigned int frameID)
 {
     currentFrameID = frameID;
+    seekPending = false;
+    if (prefetcher)
+    {
+        prefetcher->Start(frameID);
+    }
+}
+
+bool BadApple::Seek(unsigned int frameID)
+{
+    unsigned int frameCount = source->FrameCount();
+    if (frameCount != 0 && frameID > frameCount)
+    {
+        frameID = frameCount;
+    }
+    if (frameID < 1)
+    {
+        frameID = 1;
+    }
+    // Only the prefetcher reads a stream, since a read may wait for the writer and frames which are skipped are lost
+    if (!source->Seekable())
+    {
+        std::cout << "BADAPPLE: the frame source can only be read once, so it can not jump to frame " << frameID << std::endl;
+        return false;
+    }
+
+    // The source is not in use while the prefetcher is stopped
+    if (prefetcher)
+    {
+        prefetcher->Stop();
+    }
+    {
+        StageTimer timer(timings, FrameStage::Decode);
+        // The current frame is not the frame the source read last, so it decodes from the nearest keyframe
+        source->Reset();
+        seekPending = source->ReadFrame(frameID, currentFrameData.Data());
+    }
+    if (seekPending)
+    {
+        frameLoaded = true;
+        loadedFrameID = frameID;
+        frameHash = HashFrame(currentFrameData.Data(), width * height);
+        currentFrameID = frameID + 1;
+    }
+    else
+    {
+        std::cout << "BADAPPLE: could not seek to frame " << frameID << std::endl;
+        currentFrameID = frameID;
+    }
+    if (prefetcher)
+    {
+        prefetcher->Start(currentFrameID);
+    }
+    return seekPending;
+}
+
+unsigned int BadApple::GetFrameID() const
+{
+    return frameLoaded ? loadedFrameID : 0;
+}
+
+uint64_t BadApple::GetFrameHash() const
+{
+    return frameLoaded ? frameHash : 0;
+}
+
+unsigned int BadApple::GetFrameCount() const
+{
+    return source->FrameCount();
+}
+
+void BadApple::EnablePrefetch(unsigned int depth)
+{
+    prefetchDepth = depth;
+    prefetcher.reset();
+    // Without the prefetcher the source reads into the current frame, which holds a frame of the prefetcher
+    source->Reset();
+    if (prefetchDepth > 0)
+    {
+        // One buffer per slot, one for the loader, the current frame and the base of the changed runs
+        store->Reserve(prefetchDepth + 3);
+        prefetcher.reset(new FramePrefetcher(*source, *store, prefetchDepth, &timings));
+        prefetcher->Start(currentFrameID);
+    }
+}
+
+PrefetchStats BadApple::GetPrefetchStats() const
+{
+    if (!prefetcher)
+    {
+        return PrefetchStats{ 0, 0, 0 };
+    }
+    return prefetcher->Stats();
+}
+
+FrameStoreStats BadApple::GetFrameStoreStats() const
+{
+    return store->Stats();
+}
+
+void BadApple::SetFrameCacheBudget(size_t budget)
+{
+    cache.SetBudget(budget);
+}
+
+FrameCacheStats BadApple::GetFrameCacheStats() const
+{
+    return cache.Stats();
+}
+
+FrameTimings& BadApple::GetFrameTimings()
+{
+    return timings;
+}
+
+unsigned int BadApple::GetWidth() const
+{
+    return width;
+}
+
+unsigned int BadApple::GetHeight() const
+{
+    return height;
 }
 
 /*
  * Private functions
  */
 
-unsigned char* BadApple::ReadBMP(unsigned int frameID)
+void BadApple::AppendFramePoints(const unsigned char* frame, std::vector<FramePoint>& points, glm::ivec2 offset)
 {
-    unsigned int size = width * height;
-    unsigned char* data = new unsigned char[size * mul];
+    glm::ivec2 centering = glm::ivec2(width / 2, height / 2) - offset;
+
+    rowPositions.resize(width);
 
-    std::string thisPath = filepath + '_' + std::to_string(frameID) + ".bmp";
-    std::cout << "opening " << thisPath << std::endl;
-    FILE* fptr = fopen(thisPath.c_str(), "rb");
-    // skip the 54-byte header
-    fseek(fptr, 54, SEEK_SET);
-    // read image data
-    fread(data, sizeof(unsigned char) * mul, size, fptr);
-    fclose(fptr);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        unsigned int found = FindDarkPixels(frame + y * width, width, rowPositions.data());
+        for (unsigned int i = 0; i < found; i++) {
+            points.push_back(FramePoint{ int16_t(int(rowPositions[i]) - centering.x), int16_t(int(y) - centering.y) });
+        }
+    }
+}
 
-    return data;
-}
\ No newline at end of file
+void BadApple::SetSource(FrameSource* source)
+{
+    // The prefetcher reads from the old source until it is stopped
+    prefetcher.reset();
+    currentFrameData.Release();
+    changedBaseData.Release();
+    // Every source reads through the cache, which passes reads on while it is disabled
+    this->source.reset(new CachedFrameSource(source, cache));
+    width = source->Width();
+    height = source->Height();
+
+    if (!store || store->FrameSize() != width * height)
+    {
+        store.reset(new FrameStore(width * height, prefetchDepth + 3));
+    }
+    currentFrameData = store->Acquire();
+    memset(currentFrameData.Data(), UINT8_MAX, currentFrameData.Size());
+    changedBaseData = store->Acquire();
+    memset(changedBaseData.Data(), UINT8_MAX, changedBaseData.Size());
+    frameLoaded = false;
+    seekPending = false;
+    EnablePrefetch(prefetchDepth);
+}
+
+void BadApple::SetArchiveSource(ArchiveFrameSource* archiveSource, unsigned int level)
+{
+    const FrameArchive& archive = archiveSource->Archive();
+
+    this->level = level;
+    levelSizes.clear();
+    for (unsigned int i = 0; i < archive.LevelCount(); i++)
+    {
+        levelSizes.push_back(glm::uvec2(archive.LevelSize(i).width, archive.LevelSize(i).height));
+    }
+    SetSource(archiveSource);
+}
@@ -0,0 +1,221 @@
+#include "bmpfile.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const size_t FileHeaderSize = 14;
+static const size_t InfoHeaderSize = 40;
+
+static inline uint16_t ReadU16(const unsigned char* data)
+{
+    return uint16_t(data[0] | (data[1] << 8));
+}
+
+static inline uint32_t ReadU32(const unsigned char* data)
+{
+    return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+static inline void WriteU16(unsigned char* data, uint16_t value)
+{
+    data[0] = static_cast<unsigned char>(value);
+    data[1] = static_cast<unsigned char>(value >> 8);
+}
+
+static inline void WriteU32(unsigned char* data, uint32_t value)
+{
+    WriteU16(data, uint16_t(value));
+    WriteU16(data + 2, uint16_t(value >> 16));
+}
+
+/*
+ * The gray value of a blue, green and red pixel. White stays UINT8_MAX.
+ */
+static inline unsigned char Gray(unsigned char blue, unsigned char green, unsigned char red)
+{
+    return static_cast<unsigned char>((29 * blue + 150 * green + 77 * red + 128) >> 8);
+}
+
+static inline uint32_t RowStride(unsigned int width, unsigned int bitsPerPixel)
+{
+    return uint32_t((uint64_t(width) * bitsPerPixel + 31) / 32 * 4);
+}
+
+BMPHeader ParseBMPHeader(const unsigned char* data, size_t size)
+{
+    if (size < FileHeaderSize + InfoHeaderSize || data[0] != 'B' || data[1] != 'M') {
+        throw std::runtime_error("ParseBMPHeader(): not a bmp file");
+    }
+
+    uint32_t infoSize = ReadU32(data + 14);
+    if (infoSize < InfoHeaderSize || FileHeaderSize + infoSize > size) {
+        throw std::runtime_error("ParseBMPHeader(): unsupported or truncated info header");
+    }
+
+    int32_t width = int32_t(ReadU32(data + 18));
+    int32_t height = int32_t(ReadU32(data + 22));
+    uint16_t bitsPerPixel = ReadU16(data + 28);
+    uint32_t compression = ReadU32(data + 30);
+    uint32_t colorsUsed = ReadU32(data + 46);
+
+    if (width <= 0 || height == 0 || width > 65536 || height > 65536 || height < -65536) {
+        throw std::runtime_error("ParseBMPHeader(): invalid image size");
+    }
+    if (bitsPerPixel != 1 && bitsPerPixel != 8 && bitsPerPixel != 24 && bitsPerPixel != 32) {
+        throw std::runtime_error("ParseBMPHeader(): " + std::to_string(bitsPerPixel) + " bits per pixel is not supported");
+    }
+    // BI_RGB, or BI_BITFIELDS for the usual 32 bit layout
+    if (compression != 0 && !(compression == 3 && bitsPerPixel == 32)) {
+        throw std::runtime_error("ParseBMPHeader(): compressed bmp files are not supported");
+    }
+
+    BMPHeader header;
+    header.width = unsigned(width);
+    header.height = unsigned(height < 0 ? -height : height);
+    header.bitsPerPixel = bitsPerPixel;
+    header.topDown = height < 0;
+    header.dataOffset = ReadU32(data + 10);
+    header.rowStride = RowStride(header.width, bitsPerPixel);
+    memset(header.palette, 0, sizeof(header.palette));
+
+    if (bitsPerPixel <= 8) {
+        uint32_t maxColors = 1u << bitsPerPixel;
+        uint32_t colors = colorsUsed != 0 ? colorsUsed : maxColors;
+        size_t paletteOffset = FileHeaderSize + infoSize;
+        if (colors > maxColors || paletteOffset + size_t(colors) * 4 > size) {
+            throw std::runtime_error("ParseBMPHeader(): invalid palette");
+        }
+        // Palette entries are blue, green, red and a reserved byte
+        for (uint32_t i = 0; i < colors; i++)
+        {
+            const unsigned char* entry = data + paletteOffset + i * 4;
+            header.palette[i] = Gray(entry[0], entry[1], entry[2]);
+        }
+    }
+
+    if (uint64_t(header.dataOffset) + uint64_t(header.rowStride) * header.height > size) {
+        throw std::runtime_error("ParseBMPHeader(): truncated pixel data");
+    }
+
+    return header;
+}
+
+void DecodeBMPPixels(const BMPHeader& header, const unsigned char* data, unsigned char* pixels)
+{
+    for (unsigned int row = 0; row < header.height; row++)
+    {
+        const unsigned char* src = data + header.dataOffset + size_t(row) * header.rowStride;
+        unsigned int y = header.topDown ? header.height - 1 - row : row;
+        unsigned char* dst = pixels + size_t(y) * header.width;
+
+        switch (header.bitsPerPixel) {
+        case 1:
+            // The leftmost pixel is the most significant bit
+            for (unsigned int x = 0; x < header.width; x++)
+            {
+                dst[x] = header.palette[(src[x >> 3] >> (7 - (x & 7))) & 1];
+            }
+            break;
+        case 8:
+            for (unsigned int x = 0; x < header.width; x++)
+            {
+                dst[x] = header.palette[src[x]];
+            }
+            break;
+        default:
+            unsigned int bytesPerPixel = header.bitsPerPixel / 8;
+            for (unsigned int x = 0; x < header.width; x++)
+            {
+                const unsigned char* pixel = src + x * bytesPerPixel;
+                dst[x] = Gray(pixel[0], pixel[1], pixel[2]);
+            }
+            break;
+        }
+    }
+}
+
+bool ReadBMPFile(const std::string& filepath, std::vector<unsigned char>& contents)
+{
+    FILE* fptr = fopen(filepath.c_str(), "rb");
+    if (fptr == nullptr)
+    {
+        return false;
+    }
+
+    bool read = false;
+    if (fseek(fptr, 0, SEEK_END) == 0)
+    {
+        long size = ftell(fptr);
+        if (size >= 0 && fseek(fptr, 0, SEEK_SET) == 0)
+        {
+            contents.resize(size_t(size));
+            read = fread(contents.data(), 1, contents.size(), fptr) == contents.size();
+        }
+    }
+    fclose(fptr);
+
+    if (!read) {
+        throw std::runtime_error("ReadBMPFile(): cannot read " + filepath);
+    }
+    return true;
+}
+
+void WriteBMP(const std::string& filepath, unsigned int width, unsigned int height, const unsigned char* pixels, unsigned int bitsPerPixel)
+{
+    if (bitsPerPixel != 1 && bitsPerPixel != 8) {
+        throw std::runtime_error("WriteBMP(): only 1 and 8 bits per pixel can be written");
+    }
+
+    uint32_t colors = 1u << bitsPerPixel;
+    uint32_t rowStride = RowStride(width, bitsPerPixel);
+    uint32_t dataOffset = uint32_t(FileHeaderSize + InfoHeaderSize + colors * 4);
+    std::vector<unsigned char> contents(dataOffset + size_t(rowStride) * height, 0);
+    unsigned char* data = contents.data();
+
+    data[0] = 'B';
+    data[1] = 'M';
+    WriteU32(data + 2, uint32_t(contents.size()));
+    WriteU32(data + 10, dataOffset);
+    WriteU32(data + 14, InfoHeaderSize);
+    WriteU32(data + 18, width);
+    WriteU32(data + 22, height);
+    WriteU16(data + 26, 1);
+    WriteU16(data + 28, uint16_t(bitsPerPixel));
+    WriteU32(data + 34, uint32_t(size_t(rowStride) * height));
+    WriteU32(data + 46, colors);
+
+    // A gray ramp, which for 1 bit is black and white
+    for (uint32_t i = 0; i < colors; i++)
+    {
+        unsigned char gray = static_cast<unsigned char>(i * UINT8_MAX / (colors - 1));
+        unsigned char* entry = data + FileHeaderSize + InfoHeaderSize + i * 4;
+        entry[0] = entry[1] = entry[2] = gray;
+    }
+
+    for (unsigned int y = 0; y < height; y++)
+    {
+        const unsigned char* src = pixels + size_t(y) * width;
+        unsigned char* dst = data + dataOffset + size_t(y) * rowStride;
+        if (bitsPerPixel == 8) {
+            memcpy(dst, src, width);
+        }
+        else {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                if (src[x] == UINT8_MAX) {
+                    dst[x >> 3] |= static_cast<unsigned char>(0x80 >> (x & 7));
+                }
+            }
+        }
+    }
+
+    FILE* fptr = fopen(filepath.c_str(), "wb");
+    if (fptr == nullptr) {
+        throw std::runtime_error("WriteBMP(): cannot open " + filepath + " for writing");
+    }
+    size_t written = fwrite(data, 1, contents.size(), fptr);
+    fclose(fptr);
+    if (written != contents.size()) {
+        throw std::runtime_error("WriteBMP(): cannot write " + filepath);
+    }
+}
@@ -0,0 +1,646 @@
+#include "framearchive.h"
+#include "framehash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char archiveMagic[4] = { 'B', 'A', 'P', 'L' };
+
+// The level count and its padding between the header and the level table
+static const size_t levelCountSize = 8;
+
+/*
+ * Pack width * height pixels into 1 bit per pixel, most significant bit first. A set bit is a dark pixel.
+ */
+static void PackBits(const unsigned char* pixels, unsigned int size, unsigned char* bits)
+{
+    memset(bits, 0, (size + 7) / 8);
+    for (unsigned int i = 0; i < size; i++)
+    {
+        if (pixels[i] != UINT8_MAX) {
+            bits[i >> 3] |= 0x80 >> (i & 7);
+        }
+    }
+}
+
+/*
+ * Downsample a frame to black and white. A pixel is dark if at least half of the pixels it covers are dark.
+ */
+static void DownsampleFrame(const unsigned char* source, unsigned int sourceWidth, unsigned int sourceHeight,
+    unsigned char* pixels, unsigned int width, unsigned int height)
+{
+    for (unsigned int y = 0; y < height; y++)
+    {
+        unsigned int y0 = y * sourceHeight / height;
+        unsigned int y1 = std::max((y + 1) * sourceHeight / height, y0 + 1);
+        for (unsigned int x = 0; x < width; x++)
+        {
+            unsigned int x0 = x * sourceWidth / width;
+            unsigned int x1 = std::max((x + 1) * sourceWidth / width, x0 + 1);
+            unsigned int dark = 0;
+            for (unsigned int sy = y0; sy < y1; sy++)
+            {
+                const unsigned char* row = source + size_t(sy) * sourceWidth;
+                for (unsigned int sx = x0; sx < x1; sx++)
+                {
+                    dark += row[sx] != UINT8_MAX;
+                }
+            }
+            pixels[size_t(y) * width + x] = (2 * dark >= (x1 - x0) * (y1 - y0)) ? 0 : UINT8_MAX;
+        }
+    }
+}
+
+/*
+ * \class FrameArchive
+ */
+
+FrameArchive::FrameArchive(const std::string& filepath, unsigned int level)
+    : mapping(nullptr)
+    , mappingSize(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE)
+    , mappingHandle(nullptr)
+#else
+    , fileDescriptor(-1)
+#endif
+    , header(nullptr)
+    , level(level)
+    , index(nullptr)
+{
+    Map(filepath);
+    Open(filepath);
+}
+
+FrameArchive::FrameArchive(const unsigned char* data, size_t size, unsigned int level)
+    : mapping(nullptr)
+    , mappingSize(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE)
+    , mappingHandle(nullptr)
+#else
+    , fileDescriptor(-1)
+#endif
+    , header(nullptr)
+    , level(level)
+    , index(nullptr)
+{
+    // The header and the frame indices are read in place
+    if (reinterpret_cast<uintptr_t>(data) % alignof(FrameIndexEntry) != 0) {
+        throw std::runtime_error("FrameArchive: the archive in memory is not aligned to " +
+            std::to_string(alignof(FrameIndexEntry)) + " bytes");
+    }
+    mapping = data;
+    mappingSize = size;
+    Open("the archive in memory");
+}
+
+FrameArchive::~FrameArchive()
+{
+    Unmap();
+}
+
+unsigned int FrameArchive::Width() const
+{
+    return levels[level].width;
+}
+
+unsigned int FrameArchive::Height() const
+{
+    return levels[level].height;
+}
+
+unsigned int FrameArchive::FrameCount() const
+{
+    return header->frameCount;
+}
+
+unsigned int FrameArchive::FirstFrameID() const
+{
+    return header->firstFrameID;
+}
+
+unsigned int FrameArchive::LevelCount() const
+{
+    return static_cast<unsigned int>(levels.size());
+}
+
+unsigned int FrameArchive::Level() const
+{
+    return level;
+}
+
+const FrameLevelEntry& FrameArchive::LevelSize(unsigned int level) const
+{
+    if (level >= levels.size()) {
+        throw std::runtime_error("FrameArchive::LevelSize(): level out of range");
+    }
+    return levels[level];
+}
+
+const unsigned char* FrameArchive::FramePayload(unsigned int index, uint32_t& size) const
+{
+    if (index >= header->frameCount) {
+        throw std::runtime_error("FrameArchive::FramePayload(): frame index out of range");
+    }
+    size = this->index[index].size;
+    return mapping + this->index[index].offset;
+}
+
+FrameEncoding FrameArchive::Encoding(unsigned int index) const
+{
+    if (index >= header->frameCount) {
+        throw std::runtime_error("FrameArchive::Encoding(): frame index out of range");
+    }
+    return FrameEncoding(this->index[index].flags);
+}
+
+bool FrameArchive::IsKeyframe(unsigned int index) const
+{
+    return Encoding(index) != FrameEncodingDelta;
+}
+
+unsigned int FrameArchive::KeyframeIndex(unsigned int index) const
+{
+    if (index >= keyframes.size()) {
+        throw std::runtime_error("FrameArchive::KeyframeIndex(): frame index out of range");
+    }
+    return keyframes[index];
+}
+
+void FrameArchive::DecodeFrame(unsigned int index, unsigned char* pixels, std::vector<PixelRun>* changed) const
+{
+    uint32_t size;
+    const unsigned char* payload = FramePayload(index, size);
+    unsigned int pixelCount = Width() * Height();
+
+    switch (Encoding(index))
+    {
+    case FrameEncodingBits:
+        for (unsigned int i = 0; i < pixelCount; i++)
+        {
+            pixels[i] = (payload[i >> 3] & (0x80 >> (i & 7))) ? 0 : UINT8_MAX;
+        }
+        break;
+    case FrameEncodingKeyframe:
+        memset(pixels, UINT8_MAX, pixelCount);
+        ApplyFrameDelta(payload, size, pixels, pixelCount);
+        break;
+    case FrameEncodingDelta:
+        ApplyFrameDelta(payload, size, pixels, pixelCount, changed);
+        return;
+    }
+    if (changed != nullptr) {
+        changed->push_back(PixelRun{ 0, pixelCount });
+    }
+}
+
+bool FrameArchive::IsArchive(const std::string& filepath)
+{
+    FILE* fptr = fopen(filepath.c_str(), "rb");
+    if (fptr == nullptr) {
+        return false;
+    }
+    char magic[4] = { 0 };
+    size_t magicRead = fread(magic, 1, sizeof(magic), fptr);
+    fclose(fptr);
+
+    return magicRead == sizeof(magic) && memcmp(magic, archiveMagic, sizeof(magic)) == 0;
+}
+
+unsigned int FrameArchive::Pack(FrameSource& source, const std::string& filepath, unsigned int keyframeInterval,
+    const std::vector<unsigned int>& levelScales)
+{
+    std::vector<unsigned char> pixels(source.Width() * source.Height());
+    FrameArchiveWriter writer(filepath, source.Width(), source.Height(), 1, keyframeInterval, levelScales);
+
+    unsigned int frameID = 1;
+    while (source.ReadFrame(frameID, pixels.data())) {
+        writer.AddFrame(pixels.data());
+        frameID++;
+        if (source.FrameCount() != 0 && frameID > source.FrameCount()) break;
+    }
+    writer.Close();
+
+    std::cout << "BADAPPLE: packed " << writer.FrameCount() << " frames in " << levelScales.size() << " levels into "
+        << filepath << ", " << writer.SharedFrames() << " frames share the payload of an equal frame" << std::endl;
+    return writer.FrameCount();
+}
+
+/*
+ * Private functions
+ */
+
+void FrameArchive::Open(const std::string& filepath)
+{
+    try {
+        ReadLevels(filepath);
+        Validate(filepath);
+        if (level >= levels.size()) {
+            throw std::runtime_error("FrameArchive: " + filepath + " has no level " + std::to_string(level));
+        }
+    }
+    catch (...) {
+        Unmap();
+        throw;
+    }
+    header = reinterpret_cast<const FrameArchiveHeader*>(mapping);
+    index = reinterpret_cast<const FrameIndexEntry*>(mapping + levels[level].indexOffset);
+
+    // Seeking should not have to walk back through the deltas
+    keyframes.resize(header->frameCount);
+    for (uint32_t i = 0; i < header->frameCount; i++)
+    {
+        keyframes[i] = IsKeyframe(i) ? i : keyframes[i - 1];
+    }
+}
+
+void FrameArchive::Map(const std::string& filepath)
+{
+#ifdef _WIN32
+    fileHandle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("FrameArchive: could not open " + filepath);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        Unmap();
+        throw std::runtime_error("FrameArchive: could not get the size of " + filepath);
+    }
+    mappingSize = size_t(fileSize.QuadPart);
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        Unmap();
+        throw std::runtime_error("FrameArchive: could not map " + filepath);
+    }
+    mapping = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mapping == nullptr) {
+        Unmap();
+        throw std::runtime_error("FrameArchive: could not map " + filepath);
+    }
+#else
+    fileDescriptor = open(filepath.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+        throw std::runtime_error("FrameArchive: could not open " + filepath);
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+        Unmap();
+        throw std::runtime_error("FrameArchive: could not get the size of " + filepath);
+    }
+    mappingSize = size_t(fileStat.st_size);
+    void* address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (address == MAP_FAILED) {
+        Unmap();
+        throw std::runtime_error("FrameArchive: could not map " + filepath);
+    }
+    mapping = static_cast<const unsigned char*>(address);
+    // The whole archive is small and read front to back during playback
+    madvise(address, mappingSize, MADV_WILLNEED);
+#endif
+}
+
+void FrameArchive::Unmap()
+{
+    // An archive in memory has no file, and its memory is not ours to unmap
+#ifdef _WIN32
+    if (mapping != nullptr && mappingHandle != nullptr) UnmapViewOfFile(mapping);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (mapping != nullptr && fileDescriptor >= 0) munmap(const_cast<unsigned char*>(mapping), mappingSize);
+    if (fileDescriptor >= 0) close(fileDescriptor);
+    fileDescriptor = -1;
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+void FrameArchive::ReadLevels(const std::string& filepath)
+{
+    if (mappingSize < sizeof(FrameArchiveHeader)) {
+        throw std::runtime_error("FrameArchive: " + filepath + " is too small to be an archive");
+    }
+    const FrameArchiveHeader* header = reinterpret_cast<const FrameArchiveHeader*>(mapping);
+    if (memcmp(header->magic, archiveMagic, sizeof(archiveMagic)) != 0) {
+        throw std::runtime_error("FrameArchive: " + filepath + " is not a frame archive");
+    }
+    if (header->version < 1 || header->version > Version) {
+        throw std::runtime_error("FrameArchive: " + filepath + " has unsupported version " + std::to_string(header->version));
+    }
+
+    levels.clear();
+    if (header->version < 3) {
+        levels.push_back(FrameLevelEntry{ header->width, header->height, header->indexOffset });
+        return;
+    }
+
+    size_t tableOffset = sizeof(FrameArchiveHeader) + levelCountSize;
+    if (mappingSize < tableOffset) {
+        throw std::runtime_error("FrameArchive: " + filepath + " has a truncated level table");
+    }
+    uint32_t levelCount;
+    memcpy(&levelCount, mapping + sizeof(FrameArchiveHeader), sizeof(levelCount));
+    if (levelCount == 0 || levelCount > (mappingSize - tableOffset) / sizeof(FrameLevelEntry)) {
+        throw std::runtime_error("FrameArchive: " + filepath + " has a truncated level table");
+    }
+    const FrameLevelEntry* table = reinterpret_cast<const FrameLevelEntry*>(mapping + tableOffset);
+    levels.assign(table, table + levelCount);
+}
+
+void FrameArchive::Validate(const std::string& filepath) const
+{
+    const FrameArchiveHeader* header = reinterpret_cast<const FrameArchiveHeader*>(mapping);
+    for (size_t level = 0; level < levels.size(); level++)
+    {
+        const FrameLevelEntry& entry = levels[level];
+        std::string where = levels.size() > 1 ? " of level " + std::to_string(level) : std::string();
+
+        uint64_t indexSize = uint64_t(header->frameCount) * sizeof(FrameIndexEntry);
+        if (entry.indexOffset % alignof(FrameIndexEntry) != 0 ||
+            entry.indexOffset > mappingSize || indexSize > mappingSize - entry.indexOffset) {
+            throw std::runtime_error("FrameArchive: " + filepath + " has a truncated frame index" + where);
+        }
+        uint64_t frameSize = (uint64_t(entry.width) * entry.height + 7) / 8;
+        const FrameIndexEntry* index = reinterpret_cast<const FrameIndexEntry*>(mapping + entry.indexOffset);
+        for (uint32_t i = 0; i < header->frameCount; i++)
+        {
+            if (index[i].offset > mappingSize || index[i].size > mappingSize - index[i].offset ||
+                (index[i].flags == FrameEncodingBits && index[i].size < frameSize)) {
+                throw std::runtime_error("FrameArchive: " + filepath + " has a truncated frame " + std::to_string(i) + where);
+            }
+            if (index[i].flags > FrameEncodingDelta || (i == 0 && index[i].flags == FrameEncodingDelta)) {
+                throw std::runtime_error("FrameArchive: " + filepath + " has an unknown encoding of frame " + std::to_string(i) + where);
+            }
+        }
+    }
+}
+
+
+/*
+ * \class FrameArchiveWriter
+ */
+
+FrameArchiveWriter::FrameArchiveWriter(const std::string& filepath, unsigned int width, unsigned int height, unsigned int firstFrameID,
+    unsigned int keyframeInterval, const std::vector<unsigned int>& levelScales)
+    : file(nullptr)
+    , filepath(filepath)
+    , header()
+    , frameWidth(width)
+    , frameHeight(height)
+    , offset(0)
+    , sharedFrames(0)
+    , keyframeInterval(keyframeInterval)
+{
+    if (levelScales.empty()) {
+        throw std::runtime_error("FrameArchiveWriter: an archive needs at least one level");
+    }
+    for (unsigned int scale : levelScales)
+    {
+        if (scale == 0 || width / scale == 0 || height / scale == 0) {
+            throw std::runtime_error("FrameArchiveWriter: level scale " + std::to_string(scale) + " is too large for the frames");
+        }
+        Level level;
+        level.width = width / scale;
+        level.height = height / scale;
+        level.indexOffset = 0;
+        level.framesSinceKeyframe = 0;
+        if (scale != 1) {
+            level.pixels.resize(level.width * level.height);
+        }
+        levels.push_back(level);
+    }
+
+    memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+    header.version = FrameArchive::Version;
+    header.width = levels[0].width;
+    header.height = levels[0].height;
+    header.frameCount = 0;
+    header.firstFrameID = firstFrameID;
+    header.indexOffset = 0;
+
+    file = fopen(filepath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("FrameArchiveWriter: could not create " + filepath);
+    }
+    // The header is written again with the index offsets when the archive is closed
+    WriteHeader();
+}
+
+FrameArchiveWriter::~FrameArchiveWriter()
+{
+    if (file != nullptr) {
+        try {
+            Close();
+        }
+        catch (std::exception const& exception) {
+            std::cerr << exception.what() << std::endl;
+        }
+    }
+}
+
+void FrameArchiveWriter::AddFrame(const unsigned char* pixels)
+{
+    for (Level& level : levels)
+    {
+        if (level.pixels.empty()) {
+            AddLevelFrame(level, pixels);
+        }
+        else {
+            DownsampleFrame(pixels, frameWidth, frameHeight, level.pixels.data(), level.width, level.height);
+            AddLevelFrame(level, level.pixels.data());
+        }
+    }
+}
+
+void FrameArchiveWriter::Close()
+{
+    if (file == nullptr) return;
+
+    // Keep the indices aligned so they can be read in place from the mapping
+    static const unsigned char padding[alignof(FrameIndexEntry)] = { 0 };
+    for (Level& level : levels)
+    {
+        size_t paddingSize = (alignof(FrameIndexEntry) - offset % alignof(FrameIndexEntry)) % alignof(FrameIndexEntry);
+        Write(padding, paddingSize);
+
+        level.indexOffset = offset;
+        if (!level.entries.empty()) {
+            Write(level.entries.data(), level.entries.size() * sizeof(FrameIndexEntry));
+        }
+    }
+
+    header.frameCount = uint32_t(levels[0].entries.size());
+    header.indexOffset = levels[0].indexOffset;
+    fseek(file, 0, SEEK_SET);
+    WriteHeader();
+
+    int result = fclose(file);
+    file = nullptr;
+    if (result != 0) {
+        throw std::runtime_error("FrameArchiveWriter: could not close " + filepath);
+    }
+}
+
+unsigned int FrameArchiveWriter::FrameCount() const
+{
+    return static_cast<unsigned int>(levels[0].entries.size());
+}
+
+unsigned int FrameArchiveWriter::SharedFrames() const
+{
+    return sharedFrames;
+}
+
+/*
+ * Private functions
+ */
+
+void FrameArchiveWriter::AddLevelFrame(Level& level, const unsigned char* pixels)
+{
+    unsigned int pixelCount = level.width * level.height;
+    packed.resize((pixelCount + 7) / 8);
+    PackBits(pixels, pixelCount, packed.data());
+
+    const std::vector<unsigned char>* payload = &packed;
+    FrameEncoding encoding = FrameEncodingBits;
+    if (keyframeInterval > 0) {
+        EncodeFrameDelta(nullptr, pixels, pixelCount, keyframeRuns);
+        if (keyframeRuns.size() < packed.size()) {
+            payload = &keyframeRuns;
+            encoding = FrameEncodingKeyframe;
+        }
+        // A delta is only worth it if it is smaller than the keyframe, which it is not at scene cuts
+        if (!level.entries.empty() && level.framesSinceKeyframe + 1 < keyframeInterval) {
+            EncodeFrameDelta(level.previous.data(), pixels, pixelCount, deltaRuns);
+            if (deltaRuns.size() < payload->size()) {
+                payload = &deltaRuns;
+                encoding = FrameEncodingDelta;
+            }
+        }
+        level.previous.assign(pixels, pixels + pixelCount);
+    }
+
+    // An equal keyframe is free to point at, and decodes without the frames before it, so it beats
+    // any delta but an empty one
+    uint64_t hash = HashFrame(packed.data(), packed.size());
+    std::unordered_map<uint64_t, KeyframePayload>::const_iterator equal = level.keyframePayloads.find(hash);
+    if (equal != level.keyframePayloads.end() && equal->second.packed == packed
+        && !(encoding == FrameEncodingDelta && payload->empty())) {
+        level.framesSinceKeyframe = 0;
+        level.entries.push_back(equal->second.entry);
+        sharedFrames++;
+        return;
+    }
+    level.framesSinceKeyframe = (encoding == FrameEncodingDelta) ? level.framesSinceKeyframe + 1 : 0;
+
+    FrameIndexEntry entry;
+    entry.offset = offset;
+    entry.size = uint32_t(payload->size());
+    entry.flags = encoding;
+    level.entries.push_back(entry);
+    if (encoding != FrameEncodingDelta) {
+        // A frame whose hash is taken by a different frame is not shared
+        level.keyframePayloads.insert(std::make_pair(hash, KeyframePayload{ entry, packed }));
+    }
+
+    Write(payload->data(), payload->size());
+}
+
+void FrameArchiveWriter::WriteHeader()
+{
+    Write(&header, sizeof(header));
+
+    uint32_t levelCount[levelCountSize / sizeof(uint32_t)] = { uint32_t(levels.size()), 0 };
+    Write(levelCount, sizeof(levelCount));
+    for (const Level& level : levels)
+    {
+        FrameLevelEntry entry{ level.width, level.height, level.indexOffset };
+        Write(&entry, sizeof(entry));
+    }
+}
+
+void FrameArchiveWriter::Write(const void* data, size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        throw std::runtime_error("FrameArchiveWriter: could not write to " + filepath);
+    }
+    offset += size;
+}
+
+
+/*
+ * \class ArchiveFrameSource
+ */
+
+ArchiveFrameSource::ArchiveFrameSource(const std::string& filepath, unsigned int level)
+    : archive(filepath, level)
+    , lastFrameID(0)
+{
+}
+
+ArchiveFrameSource::ArchiveFrameSource(const unsigned char* data, size_t size, unsigned int level)
+    : archive(data, size, level)
+    , lastFrameID(0)
+{
+}
+
+const FrameArchive& ArchiveFrameSource::Archive() const
+{
+    return archive;
+}
+
+unsigned int ArchiveFrameSource::Width() const
+{
+    return archive.Width();
+}
+
+unsigned int ArchiveFrameSource::Height() const
+{
+    return archive.Height();
+}
+
+unsigned int ArchiveFrameSource::FrameCount() const
+{
+    return archive.FrameCount();
+}
+
+bool ArchiveFrameSource::ReadFrame(unsigned int frameID, unsigned char* pixels)
+{
+    if (frameID < archive.FirstFrameID() || frameID - archive.FirstFrameID() >= archive.FrameCount()) {
+        return false;
+    }
+    unsigned int index = frameID - archive.FirstFrameID();
+
+    // Decode from the nearest keyframe unless the previous frame is already in the buffer
+    unsigned int first = archive.KeyframeIndex(index);
+    if (lastFrameID != 0 && frameID - 1 == lastFrameID && !archive.IsKeyframe(index)) {
+        first = index;
+    }
+    for (unsigned int i = first; i <= index; i++)
+    {
+        archive.DecodeFrame(i, pixels);
+    }
+
+    lastFrameID = frameID;
+    return true;
+}
+
+void ArchiveFrameSource::Reset()
+{
+    lastFrameID = 0;
+}
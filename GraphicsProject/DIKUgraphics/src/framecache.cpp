@@ -0,0 +1,195 @@
+#include "framecache.h"
+
+#include <cstring>
+#include <iterator>
+
+/*
+ * \class FrameCache
+ */
+
+FrameCache::FrameCache(size_t budget)
+    : budget(budget)
+    , frameSize(0)
+    , hits(0)
+    , misses(0)
+    , evictions(0)
+{
+}
+
+bool FrameCache::Read(unsigned int frameID, unsigned char* pixels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = lookup.find(frameID);
+    if (found == lookup.end()) {
+        misses++;
+        return false;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    memcpy(pixels, found->second->pixels.Data(), frameSize);
+    hits++;
+    return true;
+}
+
+void FrameCache::Insert(unsigned int frameID, const unsigned char* pixels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t maxFrames = MaxFrames();
+    if (maxFrames == 0) {
+        return;
+    }
+    auto found = lookup.find(frameID);
+    if (found != lookup.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        memcpy(found->second->pixels.Data(), pixels, frameSize);
+        return;
+    }
+
+    if (entries.size() >= maxFrames) {
+        // The buffer of the least recently read frame is taken over by the new frame
+        Evict(maxFrames);
+        Entry& reused = entries.back();
+        lookup.erase(reused.frameID);
+        reused.frameID = frameID;
+        entries.splice(entries.begin(), entries, std::prev(entries.end()));
+        evictions++;
+    }
+    else {
+        entries.push_front(Entry{ frameID, store->Acquire() });
+    }
+    memcpy(entries.front().pixels.Data(), pixels, frameSize);
+    lookup[frameID] = entries.begin();
+}
+
+void FrameCache::Clear(size_t frameSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lookup.clear();
+    entries.clear();
+    if (!store || this->frameSize != frameSize) {
+        store.reset(new FrameStore(frameSize, 0));
+    }
+    this->frameSize = frameSize;
+}
+
+void FrameCache::SetBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->budget = budget;
+    Evict(MaxFrames());
+}
+
+bool FrameCache::Enabled() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return MaxFrames() > 0;
+}
+
+size_t FrameCache::FrameSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return frameSize;
+}
+
+FrameCacheStats FrameCache::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    FrameCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.frames = unsigned(entries.size());
+    stats.bytes = entries.size() * frameSize;
+    stats.budget = budget;
+    return stats;
+}
+
+/*
+ * Private functions
+ */
+
+void FrameCache::Evict(size_t frames)
+{
+    while (entries.size() > frames) {
+        lookup.erase(entries.back().frameID);
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+size_t FrameCache::MaxFrames() const
+{
+    return store && frameSize > 0 ? budget / frameSize : 0;
+}
+
+/*
+ * \class CachedFrameSource
+ */
+
+CachedFrameSource::CachedFrameSource(FrameSource* source, FrameCache& cache)
+    : source(source)
+    , cache(cache)
+    , decoded(size_t(source->Width()) * source->Height())
+    , readDecoded(false)
+{
+    cache.Clear(decoded.size());
+}
+
+FrameSource& CachedFrameSource::Source()
+{
+    return *source;
+}
+
+unsigned int CachedFrameSource::Width() const
+{
+    return source->Width();
+}
+
+unsigned int CachedFrameSource::Height() const
+{
+    return source->Height();
+}
+
+unsigned int CachedFrameSource::FrameCount() const
+{
+    return source->FrameCount();
+}
+
+bool CachedFrameSource::Seekable() const
+{
+    return source->Seekable();
+}
+
+bool CachedFrameSource::ReadFrame(unsigned int frameID, unsigned char* pixels)
+{
+    // The source reads into another buffer than last time when the cache is enabled or disabled
+    bool enabled = cache.Enabled();
+    if (enabled != readDecoded) {
+        source->Reset();
+        readDecoded = enabled;
+    }
+    if (!enabled) {
+        return source->ReadFrame(frameID, pixels);
+    }
+    if (cache.Read(frameID, pixels)) {
+        return true;
+    }
+    if (!source->ReadFrame(frameID, decoded.data())) {
+        return false;
+    }
+    cache.Insert(frameID, decoded.data());
+    memcpy(pixels, decoded.data(), decoded.size());
+    return true;
+}
+
+void CachedFrameSource::Interrupt(bool interrupted)
+{
+    source->Interrupt(interrupted);
+}
+
+void CachedFrameSource::Reset()
+{
+    // The buffer of the cached source still holds the frame the source read last
+    if (!readDecoded) {
+        source->Reset();
+    }
+}
@@ -0,0 +1,87 @@
+#include "framecodec.h"
+
+static inline bool IsDark(unsigned char pixel)
+{
+    return pixel != UINT8_MAX;
+}
+
+static void WriteVarint(uint32_t value, std::vector<unsigned char>& payload)
+{
+    while (value >= 0x80) {
+        payload.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    payload.push_back(static_cast<unsigned char>(value));
+}
+
+static uint32_t ReadVarint(const unsigned char*& data, const unsigned char* end)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (data == end) {
+            throw std::runtime_error("ApplyFrameDelta(): truncated payload");
+        }
+        unsigned char byte = *data++;
+        value |= uint32_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("ApplyFrameDelta(): malformed varint");
+}
+
+void EncodeFrameDelta(const unsigned char* previous, const unsigned char* current, unsigned int size, std::vector<unsigned char>& payload)
+{
+    payload.clear();
+
+    // A keyframe is the difference from an all white frame
+    auto changed = [previous, current](unsigned int i) {
+        bool wasDark = previous != nullptr && IsDark(previous[i]);
+        return wasDark != IsDark(current[i]);
+    };
+
+    unsigned int runEnd = 0;
+    unsigned int i = 0;
+    while (i < size)
+    {
+        if (!changed(i)) {
+            i++;
+            continue;
+        }
+        unsigned int begin = i;
+        while (i < size && changed(i)) {
+            i++;
+        }
+        WriteVarint(begin - runEnd, payload);
+        WriteVarint(i - begin, payload);
+        runEnd = i;
+    }
+}
+
+void ApplyFrameDelta(const unsigned char* payload, size_t payloadSize, unsigned char* pixels, unsigned int size, std::vector<PixelRun>* changed)
+{
+    const unsigned char* data = payload;
+    const unsigned char* end = payload + payloadSize;
+
+    uint32_t position = 0;
+    while (data != end)
+    {
+        uint32_t skip = ReadVarint(data, end);
+        uint32_t length = ReadVarint(data, end);
+        if (skip > size - position || length > size - position - skip) {
+            throw std::runtime_error("ApplyFrameDelta(): run outside of the frame");
+        }
+        position += skip;
+
+        unsigned char* pixel = pixels + position;
+        for (uint32_t i = 0; i < length; i++)
+        {
+            pixel[i] = IsDark(pixel[i]) ? UINT8_MAX : 0;
+        }
+        if (changed != nullptr && length > 0) {
+            changed->push_back(PixelRun{ position, length });
+        }
+        position += length;
+    }
+}
@@ -0,0 +1,352 @@
+#include "framecontour.h"
+#include "triangle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// The edges of a marching squares cell, where an outline crosses between two of its corner pixels
+enum CellEdge { Bottom, Right, Top, Left };
+
+/*
+ * The segments of the outline through a cell for each combination of dark corners, as pairs of edges
+ * from and to, with the dark side on the left. The corners are bottom left = 1, bottom right = 2,
+ * top right = 4 and top left = 8. In the two saddle cases the dark corners are joined through the center.
+ */
+static const int CellSegments[16][4] = {
+    { -1, -1, -1, -1 },
+    { Bottom, Left, -1, -1 },
+    { Right, Bottom, -1, -1 },
+    { Right, Left, -1, -1 },
+    { Top, Right, -1, -1 },
+    { Bottom, Right, Top, Left },
+    { Top, Bottom, -1, -1 },
+    { Top, Left, -1, -1 },
+    { Left, Top, -1, -1 },
+    { Bottom, Top, -1, -1 },
+    { Left, Bottom, Right, Top },
+    { Right, Top, -1, -1 },
+    { Left, Right, -1, -1 },
+    { Bottom, Right, -1, -1 },
+    { Left, Bottom, -1, -1 },
+    { -1, -1, -1, -1 }
+};
+
+void FrameContours::Clear()
+{
+    vertices.clear();
+    ends.clear();
+}
+
+void TraceContours(const unsigned char* pixels, unsigned int width, unsigned int height, FrameContours& contours)
+{
+    contours.Clear();
+    int w = int(width);
+    int h = int(height);
+
+    // Every crossing between two neighbouring pixels, including the white pixels around the frame, has an ID.
+    // Horizontal crossings between (x, y) and (x + 1, y) come first, then vertical ones between (x, y) and (x, y + 1).
+    size_t horizontalCount = size_t(h + 2) * (w + 1);
+    size_t crossingCount = horizontalCount + size_t(h + 1) * (w + 2);
+    std::vector<int32_t> next(crossingCount, -1);
+
+    // Two rows of the frame with a white pixel on either side, for the cells from row y to row y + 1
+    std::vector<unsigned char> below(w + 2, 0);
+    std::vector<unsigned char> above(w + 2, 0);
+
+    for (int y = -1; y < h; y++)
+    {
+        std::swap(below, above);
+        if (y + 1 < h) {
+            const unsigned char* row = pixels + size_t(y + 1) * w;
+            for (int x = 0; x < w; x++)
+            {
+                above[x + 1] = row[x] != UINT8_MAX;
+            }
+        }
+        else {
+            std::fill(above.begin(), above.end(), 0);
+        }
+
+        for (int x = -1; x < w; x++)
+        {
+            unsigned int cell = below[x + 1] | (below[x + 2] << 1) | (above[x + 2] << 2) | (above[x + 1] << 3);
+            if (cell == 0 || cell == 15) continue;
+
+            int32_t crossings[4];
+            crossings[Bottom] = int32_t(size_t(y + 1) * (w + 1) + (x + 1));
+            crossings[Top] = int32_t(size_t(y + 2) * (w + 1) + (x + 1));
+            crossings[Left] = int32_t(horizontalCount + size_t(y + 1) * (w + 2) + (x + 1));
+            crossings[Right] = crossings[Left] + 1;
+
+            const int* segments = CellSegments[cell];
+            for (int i = 0; i < 4 && segments[i] >= 0; i += 2)
+            {
+                next[crossings[segments[i]]] = crossings[segments[i + 1]];
+            }
+        }
+    }
+
+    // Every crossing on an outline has exactly one segment leaving it, so following them closes each outline
+    for (size_t start = 0; start < crossingCount; start++)
+    {
+        if (next[start] < 0) continue;
+
+        int32_t crossing = int32_t(start);
+        do {
+            if (size_t(crossing) < horizontalCount) {
+                int x = int(crossing % (w + 1)) - 1;
+                int y = int(crossing / (w + 1)) - 1;
+                contours.vertices.push_back(glm::vec2(x + 0.5f, float(y)));
+            }
+            else {
+                int32_t vertical = crossing - int32_t(horizontalCount);
+                int x = int(vertical % (w + 2)) - 1;
+                int y = int(vertical / (w + 2)) - 1;
+                contours.vertices.push_back(glm::vec2(float(x), y + 0.5f));
+            }
+            int32_t following = next[crossing];
+            next[crossing] = -1;
+            crossing = following;
+        } while (crossing >= 0 && crossing != int32_t(start));
+
+        contours.ends.push_back(uint32_t(contours.vertices.size()));
+    }
+}
+
+/*
+ * The distance from a point to the segment from a to b.
+ */
+static float SegmentDistance(glm::vec2 point, glm::vec2 a, glm::vec2 b)
+{
+    glm::vec2 ab = b - a;
+    glm::vec2 ap = point - a;
+    float lengthSquared = ab.x * ab.x + ab.y * ab.y;
+    float t = lengthSquared > 0.0f ? std::max(0.0f, std::min(1.0f, (ap.x * ab.x + ap.y * ab.y) / lengthSquared)) : 0.0f;
+    glm::vec2 offset = ap - ab * t;
+    return std::sqrt(offset.x * offset.x + offset.y * offset.y);
+}
+
+void SimplifyContours(const FrameContours& contours, float tolerance, FrameContours& simplified)
+{
+    simplified.Clear();
+    std::vector<unsigned char> keep;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+
+    uint32_t begin = 0;
+    for (uint32_t end : contours.ends)
+    {
+        const glm::vec2* polygon = contours.vertices.data() + begin;
+        uint32_t count = end - begin;
+        begin = end;
+        if (count < 3) continue;
+
+        // Index count is the first vertex again, which closes the polygon
+        auto vertex = [&](uint32_t i) { return polygon[i % count]; };
+
+        // A closed polygon is split at its first vertex and the vertex farthest from it, which both stay
+        uint32_t farthest = 0;
+        float farthestDistance = -1.0f;
+        for (uint32_t i = 1; i < count; i++)
+        {
+            glm::vec2 offset = polygon[i] - polygon[0];
+            float distance = offset.x * offset.x + offset.y * offset.y;
+            if (distance > farthestDistance) {
+                farthest = i;
+                farthestDistance = distance;
+            }
+        }
+
+        keep.assign(count + 1, 0);
+        keep[0] = 1;
+        keep[farthest] = 1;
+        stack.clear();
+        stack.push_back(std::make_pair(0u, farthest));
+        stack.push_back(std::make_pair(farthest, count));
+        while (!stack.empty())
+        {
+            uint32_t first = stack.back().first;
+            uint32_t last = stack.back().second;
+            stack.pop_back();
+
+            uint32_t worst = first;
+            float worstDistance = tolerance;
+            for (uint32_t i = first + 1; i < last; i++)
+            {
+                float distance = SegmentDistance(vertex(i), vertex(first), vertex(last));
+                if (distance > worstDistance) {
+                    worst = i;
+                    worstDistance = distance;
+                }
+            }
+            if (worst != first) {
+                keep[worst] = 1;
+                stack.push_back(std::make_pair(first, worst));
+                stack.push_back(std::make_pair(worst, last));
+            }
+        }
+
+        size_t first = simplified.vertices.size();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (keep[i]) {
+                simplified.vertices.push_back(polygon[i]);
+            }
+        }
+        if (simplified.vertices.size() - first < 3) {
+            simplified.vertices.resize(first);
+        }
+        else {
+            simplified.ends.push_back(uint32_t(simplified.vertices.size()));
+        }
+    }
+}
+
+// An edge of a polygon from its lower to its upper end
+struct ContourEdge {
+    glm::vec2 lower;
+    glm::vec2 upper;
+
+    float X(float y) const
+    {
+        return lower.x + (upper.x - lower.x) * (y - lower.y) / (upper.y - lower.y);
+    }
+};
+
+// A trapezoid between two edges which has not been closed yet
+struct OpenTrapezoid {
+    uint32_t left;
+    uint32_t right;
+    float y;
+    float xLeft;
+    float xRight;
+};
+
+/*
+ * Emit the trapezoid from its bottom up to height y as up to two counter-clockwise triangles.
+ */
+static void CloseTrapezoid(const OpenTrapezoid& trapezoid, const std::vector<ContourEdge>& edges, float y,
+    std::vector<glm::vec2>& triangles)
+{
+    if (y <= trapezoid.y) return;
+    float xLeft = edges[trapezoid.left].X(y);
+    float xRight = edges[trapezoid.right].X(y);
+    if (trapezoid.xRight > trapezoid.xLeft) {
+        triangles.push_back(glm::vec2(trapezoid.xLeft, trapezoid.y));
+        triangles.push_back(glm::vec2(trapezoid.xRight, trapezoid.y));
+        triangles.push_back(glm::vec2(xRight, y));
+    }
+    if (xRight > xLeft) {
+        triangles.push_back(glm::vec2(trapezoid.xLeft, trapezoid.y));
+        triangles.push_back(glm::vec2(xRight, y));
+        triangles.push_back(glm::vec2(xLeft, y));
+    }
+}
+
+void TriangulateContours(const FrameContours& contours, std::vector<glm::vec2>& triangles)
+{
+    triangles.clear();
+
+    // The edges sorted by their lower end; horizontal edges bound no trapezoid
+    std::vector<ContourEdge> edges;
+    std::vector<float> heights;
+    uint32_t begin = 0;
+    for (uint32_t end : contours.ends)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            glm::vec2 a = contours.vertices[i];
+            glm::vec2 b = contours.vertices[i + 1 < end ? i + 1 : begin];
+            heights.push_back(a.y);
+            if (a.y != b.y) {
+                edges.push_back(a.y < b.y ? ContourEdge{ a, b } : ContourEdge{ b, a });
+            }
+        }
+        begin = end;
+    }
+    std::sort(edges.begin(), edges.end(), [](const ContourEdge& a, const ContourEdge& b) { return a.lower.y < b.lower.y; });
+    std::sort(heights.begin(), heights.end());
+    heights.erase(std::unique(heights.begin(), heights.end()), heights.end());
+
+    std::vector<uint32_t> active;
+    std::vector<std::pair<float, uint32_t>> crossings;
+    std::vector<OpenTrapezoid> open;
+    std::vector<OpenTrapezoid> continued;
+    size_t nextEdge = 0;
+    for (size_t band = 0; band + 1 < heights.size(); band++)
+    {
+        float y0 = heights[band];
+        float y1 = heights[band + 1];
+
+        active.erase(std::remove_if(active.begin(), active.end(),
+            [&](uint32_t edge) { return edges[edge].upper.y <= y0; }), active.end());
+        while (nextEdge < edges.size() && edges[nextEdge].lower.y <= y0) {
+            active.push_back(uint32_t(nextEdge++));
+        }
+
+        // No vertex lies inside the band, so the edges can be ordered by where they cross its middle
+        float middle = 0.5f * (y0 + y1);
+        crossings.clear();
+        for (uint32_t edge : active)
+        {
+            crossings.push_back(std::make_pair(edges[edge].X(middle), edge));
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // Every other gap between the edges is inside. A trapezoid between the same edges as one in the band
+        // below goes on, the others are new.
+        continued.clear();
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+        {
+            uint32_t left = crossings[i].second;
+            uint32_t right = crossings[i + 1].second;
+            std::vector<OpenTrapezoid>::iterator below = std::find_if(open.begin(), open.end(),
+                [&](const OpenTrapezoid& trapezoid) { return trapezoid.left == left && trapezoid.right == right; });
+            if (below != open.end()) {
+                continued.push_back(*below);
+                // Taken, so it is not closed at the bottom of this band
+                below->left = below->right;
+            }
+            else {
+                continued.push_back(OpenTrapezoid{ left, right, y0, edges[left].X(y0), edges[right].X(y0) });
+            }
+        }
+        for (const OpenTrapezoid& trapezoid : open)
+        {
+            if (trapezoid.left != trapezoid.right) {
+                CloseTrapezoid(trapezoid, edges, y0, triangles);
+            }
+        }
+        std::swap(open, continued);
+    }
+    for (const OpenTrapezoid& trapezoid : open)
+    {
+        CloseTrapezoid(trapezoid, edges, heights.back(), triangles);
+    }
+}
+
+void RasterizeTriangles(const std::vector<glm::vec2>& triangles, unsigned int width, unsigned int height, unsigned char* pixels)
+{
+    memset(pixels, UINT8_MAX, size_t(width) * height);
+
+    for (size_t i = 0; i + 2 < triangles.size(); i += 3)
+    {
+        // At twice the resolution the centers of the pixels are the even fragments
+        glm::ivec2 vertices[3];
+        for (int j = 0; j < 3; j++)
+        {
+            vertices[j] = glm::ivec2(int(std::lround(2.0f * triangles[i + j].x)), int(std::lround(2.0f * triangles[i + j].y)));
+        }
+
+        triangle_rasterizer rasterizer(vertices[0].x, vertices[0].y, vertices[1].x, vertices[1].y, vertices[2].x, vertices[2].y);
+        while (rasterizer.more_fragments())
+        {
+            int x = rasterizer.x();
+            int y = rasterizer.y();
+            if (x >= 0 && y >= 0 && x % 2 == 0 && y % 2 == 0 && unsigned(x / 2) < width && unsigned(y / 2) < height) {
+                pixels[size_t(y / 2) * width + x / 2] = 0;
+            }
+            rasterizer.next_fragment();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#include "framehash.h"
+
+#include <cstring>
+
+// The primes and rounds of xxHash64, which hashes 8 bytes per multiplication and mixes every input bit
+// into every output bit
+static const uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t Prime3 = 0x165667B19E3779F9ull;
+static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t RotateLeft(uint64_t value, unsigned int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t Round(uint64_t accumulator, uint64_t word)
+{
+    accumulator += word * Prime2;
+    return RotateLeft(accumulator, 31) * Prime1;
+}
+
+static inline uint64_t ReadWord(const unsigned char* data)
+{
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+uint64_t HashFrame(const unsigned char* data, size_t size)
+{
+    const unsigned char* end = data + size;
+    uint64_t hash;
+
+    // Four independent lanes of 8 bytes each, so the multiplications of a 32 byte block run in parallel
+    if (size >= 32) {
+        uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+        for (; end - data >= 32; data += 32)
+        {
+            for (unsigned int lane = 0; lane < 4; lane++)
+            {
+                lanes[lane] = Round(lanes[lane], ReadWord(data + 8 * lane));
+            }
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (unsigned int lane = 0; lane < 4; lane++)
+        {
+            hash = (hash ^ Round(0, lanes[lane])) * Prime1 + Prime4;
+        }
+    }
+    else {
+        hash = Prime5;
+    }
+    hash += uint64_t(size);
+
+    for (; end - data >= 8; data += 8)
+    {
+        hash = RotateLeft(hash ^ Round(0, ReadWord(data)), 27) * Prime1 + Prime4;
+    }
+    for (; data < end; data++)
+    {
+        hash = RotateLeft(hash ^ (*data * Prime5), 11) * Prime1;
+    }
+
+    // Let every bit of the last words reach every bit of the hash
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash != 0 ? hash : 1;
+}
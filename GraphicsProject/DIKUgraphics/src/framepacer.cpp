@@ -0,0 +1,89 @@
+#include "framepacer.h"
+
+#include <cmath>
+
+FramePacer::FramePacer(double fps, double lateMilliseconds)
+    : fps(fps > 0.0 ? fps : 1.0)
+    , lateMilliseconds(lateMilliseconds)
+    , frames(0)
+    , lateFrames(0)
+    , skippedDeadlines(0)
+    , maxLateMilliseconds(0.0)
+{
+    Restart();
+}
+
+void FramePacer::Restart()
+{
+    start = Clock::now();
+    next = 0;
+}
+
+bool FramePacer::Due() const
+{
+    return Clock::now() >= Deadline(next);
+}
+
+double FramePacer::SecondsUntilDue() const
+{
+    std::chrono::duration<double> wait = Deadline(next) - Clock::now();
+    return wait.count() > 0.0 ? wait.count() : 0.0;
+}
+
+double FramePacer::Advance()
+{
+    Clock::time_point now = Clock::now();
+    std::chrono::duration<double, std::milli> late = now - Deadline(next);
+
+    frames++;
+    if (late.count() > lateMilliseconds) {
+        lateFrames++;
+    }
+    if (late.count() > maxLateMilliseconds) {
+        maxLateMilliseconds = late.count();
+    }
+
+    next++;
+    if (now >= Deadline(next)) {
+        // The first deadline after now, which keeps the frames on the same grid
+        std::chrono::duration<double> elapsed = now - start;
+        uint64_t first = uint64_t(std::floor(elapsed.count() * fps)) + 1;
+        if (first > next) {
+            skippedDeadlines += first - next;
+            next = first;
+        }
+    }
+
+    return late.count() > 0.0 ? late.count() : 0.0;
+}
+
+uint64_t FramePacer::Frames() const
+{
+    return frames;
+}
+
+uint64_t FramePacer::LateFrames() const
+{
+    return lateFrames;
+}
+
+uint64_t FramePacer::SkippedDeadlines() const
+{
+    return skippedDeadlines;
+}
+
+double FramePacer::MaxLateMilliseconds() const
+{
+    return maxLateMilliseconds;
+}
+
+/*
+ * Private functions
+ */
+
+FramePacer::Clock::time_point FramePacer::Deadline(uint64_t frame) const
+{
+    // Computed from the start every time, so rounding does not add up
+    std::chrono::duration<double> offset(double(frame) / fps);
+    return start + std::chrono::duration_cast<Clock::duration>(offset);
+}
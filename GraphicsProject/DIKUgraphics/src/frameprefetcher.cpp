@@ -0,0 +1,148 @@
+#include "frameprefetcher.h"
+#include "framehash.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+FramePrefetcher::FramePrefetcher(FrameSource& source, FrameStore& store, unsigned int capacity, FrameTimings* timings)
+    : source(source)
+    , store(store)
+    , timings(timings)
+    , slots(capacity > 0 ? capacity : 1)
+    , head(0)
+    , tail(0)
+    , running(false)
+    , endOfSource(false)
+    , framesLoaded(0)
+    , framesDelivered(0)
+    , underruns(0)
+{
+    if (store.FrameSize() < size_t(source.Width()) * source.Height()) {
+        throw std::runtime_error("FramePrefetcher: the frame buffers are smaller than the frames");
+    }
+    for (Slot& slot : slots)
+    {
+        slot.pixels = store.Acquire();
+        slot.frameID = 0;
+        slot.hash = 0;
+    }
+    working = store.Acquire();
+    memset(working.Data(), UINT8_MAX, working.Size());
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    Stop();
+}
+
+void FramePrefetcher::Start(unsigned int frameID)
+{
+    Stop();
+    // The source may have been read into other buffers while the loader was stopped
+    source.Reset();
+    running = true;
+    loader = std::thread(&FramePrefetcher::Load, this, frameID);
+}
+
+void FramePrefetcher::Stop()
+{
+    if (loader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wakeup.notify_one();
+        // The loader may be waiting for a stream to deliver a frame
+        source.Interrupt(true);
+        loader.join();
+        source.Interrupt(false);
+    }
+    running = false;
+    endOfSource = false;
+    head = 0;
+    tail = 0;
+}
+
+bool FramePrefetcher::Pop(FrameBuffer& pixels, unsigned int& frameID, uint64_t& hash)
+{
+    uint64_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail == head.load(std::memory_order_acquire)) {
+        if (running && !endOfSource) {
+            underruns++;
+        }
+        return false;
+    }
+
+    Slot& slot = slots[currentTail % slots.size()];
+    pixels.swap(slot.pixels);
+    frameID = slot.frameID;
+    hash = slot.hash;
+    tail.store(currentTail + 1, std::memory_order_release);
+    framesDelivered++;
+
+    wakeup.notify_one();
+    return true;
+}
+
+bool FramePrefetcher::Finished() const
+{
+    return endOfSource && tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+}
+
+PrefetchStats FramePrefetcher::Stats() const
+{
+    PrefetchStats stats;
+    stats.framesLoaded = framesLoaded;
+    stats.framesDelivered = framesDelivered;
+    stats.underruns = underruns;
+    return stats;
+}
+
+/*
+ * Private functions
+ */
+
+void FramePrefetcher::Load(unsigned int frameID)
+{
+    while (running)
+    {
+        uint64_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead - tail.load(std::memory_order_acquire) == slots.size()) {
+            // The ring is full, so wait until the consumer takes a frame
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeup.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+
+        // The working buffer always holds the last loaded frame, so sources can decode incrementally
+        bool loaded = false;
+        try {
+            FrameTimings::Clock::time_point start = FrameTimings::Clock::now();
+            loaded = source.ReadFrame(frameID, working.Data());
+            if (timings && loaded) {
+                timings->Record(FrameStage::Decode, FrameTimings::Clock::now() - start);
+            }
+        }
+        catch (std::exception& error) {
+            // There is no one to catch it on this thread, so a broken frame ends the frames
+            std::cerr << "FramePrefetcher: " << error.what() << std::endl;
+        }
+        if (!loaded) {
+            endOfSource = true;
+            break;
+        }
+
+        Slot& slot = slots[currentHead % slots.size()];
+        if (!slot.pixels) {
+            slot.pixels = store.Acquire();
+        }
+        // Copy rather than swap: the next delta is applied on top of the frame in working, and only Pop() swaps
+        memcpy(slot.pixels.Data(), working.Data(), working.Size());
+        slot.frameID = frameID;
+        slot.hash = HashFrame(slot.pixels.Data(), size_t(source.Width()) * source.Height());
+        head.store(currentHead + 1, std::memory_order_release);
+        framesLoaded++;
+        frameID++;
+    }
+}
@@ -0,0 +1,166 @@
+#include "framereduce.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX2__)
+#define FRAMEREDUCE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMEREDUCE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The weights of the blue, green and red channels in a gray value, out of 256. The same as for bmp files.
+static const uint32_t BlueWeight = 29;
+static const uint32_t GreenWeight = 150;
+static const uint32_t RedWeight = 77;
+
+/*
+ * True if the average gray value of count pixels is above threshold, given the sum of their weighted channels.
+ * For one pixel this is the rounded gray value of a bmp file compared to the threshold.
+ */
+static inline bool IsWhite(uint64_t weighted, uint64_t count, unsigned int threshold)
+{
+    return weighted + 128 * count >= (uint64_t(threshold) + 1) * 256 * count;
+}
+
+/*
+ * The first pixel of the large frame covered by pixel i of the smaller frame.
+ */
+static inline unsigned int BoxBegin(unsigned int i, unsigned int size, unsigned int outSize)
+{
+    return unsigned(uint64_t(i) * size / outSize);
+}
+
+/*
+ * One past the last pixel of the large frame covered by pixel i of the smaller frame. At least one pixel is covered.
+ */
+static inline unsigned int BoxEnd(unsigned int i, unsigned int size, unsigned int outSize)
+{
+    return std::max(BoxBegin(i + 1, size, outSize), BoxBegin(i, size, outSize) + 1);
+}
+
+/*
+ * Add the bytes of a row to the column sums, a whole vector register at a time.
+ */
+static void AccumulateRow(const unsigned char* row, unsigned int count, uint32_t* sums)
+{
+    unsigned int i = 0;
+
+#if defined(FRAMEREDUCE_AVX2)
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m256i low = _mm256_cvtepu8_epi32(block);
+        __m256i high = _mm256_cvtepu8_epi32(_mm_srli_si128(block, 8));
+        __m256i* sum = reinterpret_cast<__m256i*>(sums + i);
+        _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum), low));
+        _mm256_storeu_si256(sum + 1, _mm256_add_epi32(_mm256_loadu_si256(sum + 1), high));
+    }
+#elif defined(FRAMEREDUCE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i low = _mm_unpacklo_epi8(block, zero);
+        __m128i high = _mm_unpackhi_epi8(block, zero);
+        __m128i words[4] = {
+            _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+            _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+        };
+        __m128i* sum = reinterpret_cast<__m128i*>(sums + i);
+        for (int j = 0; j < 4; j++)
+        {
+            _mm_storeu_si128(sum + j, _mm_add_epi32(_mm_loadu_si128(sum + j), words[j]));
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        sums[i] += row[i];
+    }
+}
+
+static void ReduceNearest(const unsigned char* bgr, unsigned int width, unsigned int height, size_t stride,
+    unsigned int outWidth, unsigned int outHeight, unsigned int threshold, unsigned char* pixels)
+{
+    for (unsigned int y = 0; y < outHeight; y++)
+    {
+        // The smaller frame is stored bottom row first
+        const unsigned char* src = bgr + BoxBegin(outHeight - 1 - y, height, outHeight) * stride;
+        unsigned char* dst = pixels + size_t(y) * outWidth;
+        for (unsigned int x = 0; x < outWidth; x++)
+        {
+            const unsigned char* pixel = src + size_t(BoxBegin(x, width, outWidth)) * 3;
+            uint32_t weighted = BlueWeight * pixel[0] + GreenWeight * pixel[1] + RedWeight * pixel[2];
+            dst[x] = IsWhite(weighted, 1, threshold) ? UINT8_MAX : 0;
+        }
+    }
+}
+
+static void ReduceArea(const unsigned char* bgr, unsigned int width, unsigned int height, size_t stride,
+    unsigned int outWidth, unsigned int outHeight, unsigned int threshold, unsigned char* pixels)
+{
+    // The sum of each byte column over the rows of one row of the smaller frame.
+    // Adding whole rows needs no deinterleaving of the channels, so it is done with vector instructions.
+    static thread_local std::vector<uint32_t> sums;
+    sums.resize(size_t(width) * 3);
+
+    for (unsigned int y = 0; y < outHeight; y++)
+    {
+        unsigned int top = outHeight - 1 - y;
+        unsigned int rowBegin = BoxBegin(top, height, outHeight);
+        unsigned int rowEnd = BoxEnd(top, height, outHeight);
+
+        std::fill(sums.begin(), sums.end(), 0);
+        for (unsigned int row = rowBegin; row < rowEnd; row++)
+        {
+            AccumulateRow(bgr + row * stride, width * 3, sums.data());
+        }
+
+        unsigned char* dst = pixels + size_t(y) * outWidth;
+        for (unsigned int x = 0; x < outWidth; x++)
+        {
+            unsigned int columnBegin = BoxBegin(x, width, outWidth);
+            unsigned int columnEnd = BoxEnd(x, width, outWidth);
+            uint64_t blue = 0;
+            uint64_t green = 0;
+            uint64_t red = 0;
+            for (const uint32_t* sum = sums.data() + size_t(columnBegin) * 3; sum != sums.data() + size_t(columnEnd) * 3; sum += 3)
+            {
+                blue += sum[0];
+                green += sum[1];
+                red += sum[2];
+            }
+            uint64_t count = uint64_t(columnEnd - columnBegin) * (rowEnd - rowBegin);
+            dst[x] = IsWhite(BlueWeight * blue + GreenWeight * green + RedWeight * red, count, threshold) ? UINT8_MAX : 0;
+        }
+    }
+}
+
+void ReduceFrame(const unsigned char* bgr, unsigned int width, unsigned int height, size_t stride,
+    unsigned int outWidth, unsigned int outHeight, unsigned int threshold, ReduceFilter filter, unsigned char* pixels)
+{
+    if (width == 0 || height == 0 || outWidth == 0 || outHeight == 0) {
+        throw std::runtime_error("ReduceFrame(): frame sizes must not be zero");
+    }
+
+    if (filter == ReduceFilter::Area) {
+        ReduceArea(bgr, width, height, stride, outWidth, outHeight, threshold, pixels);
+    }
+    else {
+        ReduceNearest(bgr, width, height, stride, outWidth, outHeight, threshold, pixels);
+    }
+}
+
+const char* FrameReduceInstructionSet()
+{
+#if defined(FRAMEREDUCE_AVX2)
+    return "AVX2";
+#elif defined(FRAMEREDUCE_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
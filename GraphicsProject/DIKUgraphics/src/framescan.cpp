@@ -0,0 +1,138 @@
+#include "framescan.h"
+
+#if defined(__AVX2__)
+#define FRAMESCAN_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMESCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline unsigned int CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/*
+ * Append the position of every set bit in mask, lowest bit first.
+ */
+static inline unsigned int EmitPositions(uint32_t mask, unsigned int x, uint16_t* positions)
+{
+    unsigned int found = 0;
+    while (mask != 0) {
+        positions[found++] = uint16_t(x + CountTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+    return found;
+}
+
+unsigned int FindDarkPixels(const unsigned char* pixels, unsigned int count, uint16_t* positions)
+{
+    unsigned int found = 0;
+    unsigned int x = 0;
+
+#if defined(FRAMESCAN_AVX2)
+    const __m256i white = _mm256_set1_epi8(char(UINT8_MAX));
+    for (; x + 32 <= count; x += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + x));
+        uint32_t dark = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, white)));
+        found += EmitPositions(dark, x, positions + found);
+    }
+#endif
+#if defined(FRAMESCAN_AVX2) || defined(FRAMESCAN_SSE2)
+    const __m128i white16 = _mm_set1_epi8(char(UINT8_MAX));
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + x));
+        uint32_t dark = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, white16))) & 0xFFFF;
+        found += EmitPositions(dark, x, positions + found);
+    }
+#endif
+    for (; x < count; x++)
+    {
+        if (pixels[x] != UINT8_MAX) {
+            positions[found++] = uint16_t(x);
+        }
+    }
+
+    return found;
+}
+
+/*
+ * Skip the pixels at the start of two rows which are equal, a whole vector register at a time.
+ */
+static unsigned int SkipEqualPixels(const unsigned char* previous, const unsigned char* current, unsigned int x, unsigned int count)
+{
+#if defined(FRAMESCAN_AVX2)
+    for (; x + 32 <= count; x += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + x));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + x));
+        uint32_t differ = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+        if (differ != 0) {
+            return x + CountTrailingZeros(differ);
+        }
+    }
+#endif
+#if defined(FRAMESCAN_AVX2) || defined(FRAMESCAN_SSE2)
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + x));
+        uint32_t differ = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) & 0xFFFF;
+        if (differ != 0) {
+            return x + CountTrailingZeros(differ);
+        }
+    }
+#endif
+    while (x < count && previous[x] == current[x]) {
+        x++;
+    }
+    return x;
+}
+
+void FindChangedRuns(const unsigned char* previous, const unsigned char* current, unsigned int count, unsigned int mergeGap, std::vector<PixelRun>& runs)
+{
+    runs.clear();
+
+    unsigned int x = 0;
+    while (true)
+    {
+        x = SkipEqualPixels(previous, current, x, count);
+        if (x >= count) break;
+
+        unsigned int begin = x;
+        while (x < count && previous[x] != current[x]) {
+            x++;
+        }
+
+        if (!runs.empty() && begin - (runs.back().begin + runs.back().length) < mergeGap) {
+            runs.back().length = x - runs.back().begin;
+        }
+        else {
+            runs.push_back(PixelRun{ begin, x - begin });
+        }
+    }
+}
+
+const char* FrameScanInstructionSet()
+{
+#if defined(FRAMESCAN_AVX2)
+    return "AVX2";
+#elif defined(FRAMESCAN_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,93 @@
+#include "framesource.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include "bmpfile.h"
+
+/*
+ * Parse the header of a bmp file in data, naming the file in the error.
+ */
+static BMPHeader ReadHeader(const std::vector<unsigned char>& data, const std::string& thisPath)
+{
+    try {
+        return ParseBMPHeader(data.data(), data.size());
+    }
+    catch (std::runtime_error& error) {
+        throw std::runtime_error("BMPFrameSource: " + thisPath + ": " + error.what());
+    }
+}
+
+BMPFrameSource::BMPFrameSource(unsigned int width, unsigned int height, std::string filepath, bool verbose)
+    : width(width)
+    , height(height)
+    , filepath(filepath)
+    , verbose(verbose)
+{
+}
+
+BMPFrameSource::BMPFrameSource(std::string filepath, bool verbose)
+    : width(0)
+    , height(0)
+    , filepath(filepath)
+    , verbose(verbose)
+{
+    std::string firstPath = filepath + "_1.bmp";
+    if (!ReadBMPFile(firstPath, fileData)) {
+        throw std::runtime_error("BMPFrameSource: cannot open " + firstPath + ": " + strerror(errno));
+    }
+    BMPHeader header = ReadHeader(fileData, firstPath);
+    width = header.width;
+    height = header.height;
+}
+
+unsigned int BMPFrameSource::Width() const
+{
+    return width;
+}
+
+unsigned int BMPFrameSource::Height() const
+{
+    return height;
+}
+
+unsigned int BMPFrameSource::FrameCount() const
+{
+    // The number of frames in the directory is only known when a read fails
+    return 0;
+}
+
+bool BMPFrameSource::ReadFrame(unsigned int frameID, unsigned char* pixels)
+{
+    return ReadBMP(frameID, pixels);
+}
+
+/*
+ * Private functions
+ */
+
+bool BMPFrameSource::ReadBMP(unsigned int frameID, unsigned char* pixels)
+{
+    std::string thisPath = filepath + '_' + std::to_string(frameID) + ".bmp";
+    if (verbose) {
+        std::cout << "opening " << thisPath << std::endl;
+    }
+    if (!ReadBMPFile(thisPath, fileData))
+    {
+        // A missing file is the end of the frames, anything else is an error
+        if (errno == ENOENT) {
+            return false;
+        }
+        throw std::runtime_error("BMPFrameSource: cannot open " + thisPath + ": " + strerror(errno));
+    }
+
+    BMPHeader header = ReadHeader(fileData, thisPath);
+    if (header.width != width || header.height != height) {
+        throw std::runtime_error("BMPFrameSource: " + thisPath + " is " + std::to_string(header.width) + "x"
+            + std::to_string(header.height) + " pixels, expected " + std::to_string(width) + "x" + std::to_string(height));
+    }
+
+    DecodeBMPPixels(header, fileData.data(), pixels);
+
+    return true;
+}
@@ -0,0 +1,213 @@
+#include "framestore.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static unsigned char* AlignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    void* data = _aligned_malloc(size, alignment);
+#else
+    void* data = nullptr;
+    if (posix_memalign(&data, alignment, size) != 0) {
+        data = nullptr;
+    }
+#endif
+    if (data == nullptr) {
+        throw std::bad_alloc();
+    }
+    return static_cast<unsigned char*>(data);
+}
+
+static void AlignedFree(unsigned char* data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+/*
+ * \class FrameBuffer
+ */
+
+FrameBuffer::FrameBuffer()
+    : store(nullptr)
+    , data(nullptr)
+{
+}
+
+FrameBuffer::FrameBuffer(FrameStore* store, unsigned char* data)
+    : store(store)
+    , data(data)
+{
+}
+
+FrameBuffer::~FrameBuffer()
+{
+    Release();
+}
+
+FrameBuffer::FrameBuffer(FrameBuffer&& other) noexcept
+    : store(other.store)
+    , data(other.data)
+{
+    other.store = nullptr;
+    other.data = nullptr;
+}
+
+FrameBuffer& FrameBuffer::operator=(FrameBuffer&& other) noexcept
+{
+    if (this != &other) {
+        Release();
+        std::swap(store, other.store);
+        std::swap(data, other.data);
+    }
+    return *this;
+}
+
+unsigned char* FrameBuffer::Data()
+{
+    return data;
+}
+
+const unsigned char* FrameBuffer::Data() const
+{
+    return data;
+}
+
+size_t FrameBuffer::Size() const
+{
+    return store != nullptr ? store->FrameSize() : 0;
+}
+
+FrameBuffer::operator bool() const
+{
+    return data != nullptr;
+}
+
+unsigned char& FrameBuffer::operator[](size_t i)
+{
+    return data[i];
+}
+
+const unsigned char& FrameBuffer::operator[](size_t i) const
+{
+    return data[i];
+}
+
+void FrameBuffer::swap(FrameBuffer& other)
+{
+    std::swap(store, other.store);
+    std::swap(data, other.data);
+}
+
+void FrameBuffer::Release()
+{
+    if (data != nullptr) {
+        store->Release(data);
+    }
+    store = nullptr;
+    data = nullptr;
+}
+
+/*
+ * \class FrameStore
+ */
+
+FrameStore::FrameStore(size_t frameSize, unsigned int capacity, size_t alignment)
+    : frameSize(frameSize)
+    , alignment(alignment)
+    , stats()
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("FrameStore: the alignment must be a power of two");
+    }
+    Reserve(capacity);
+}
+
+FrameStore::~FrameStore()
+{
+    if (freeBuffers.size() != buffers.size()) {
+        std::cerr << "FrameStore: destroyed with " << buffers.size() - freeBuffers.size() << " buffers in use" << std::endl;
+    }
+    for (unsigned char* buffer : buffers)
+    {
+        AlignedFree(buffer);
+    }
+}
+
+FrameBuffer FrameStore::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    unsigned char* data;
+    if (freeBuffers.empty()) {
+        data = Allocate();
+    }
+    else {
+        data = freeBuffers.back();
+        freeBuffers.pop_back();
+        stats.reuses++;
+    }
+    stats.acquires++;
+    stats.inUse++;
+    if (stats.inUse > stats.peakInUse) {
+        stats.peakInUse = stats.inUse;
+    }
+    return FrameBuffer(this, data);
+}
+
+void FrameStore::Reserve(unsigned int capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    while (buffers.size() < capacity)
+    {
+        freeBuffers.push_back(Allocate());
+    }
+}
+
+size_t FrameStore::FrameSize() const
+{
+    return frameSize;
+}
+
+FrameStoreStats FrameStore::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+/*
+ * Private functions
+ */
+
+void FrameStore::Release(unsigned char* data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    freeBuffers.push_back(data);
+    stats.inUse--;
+}
+
+unsigned char* FrameStore::Allocate()
+{
+    // Round the size up so every buffer can be read in whole vector registers
+    size_t size = (frameSize + alignment - 1) / alignment * alignment;
+    unsigned char* data = AlignedAlloc(size > 0 ? size : alignment, alignment);
+    buffers.reserve(buffers.size() + 1);
+    buffers.push_back(data);
+    freeBuffers.reserve(buffers.size());
+
+    stats.allocations++;
+    stats.bytesAllocated += size;
+    return data;
+}
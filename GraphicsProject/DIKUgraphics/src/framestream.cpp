@@ -0,0 +1,231 @@
+#include "framestream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+// How long a read waits for data before it looks whether it is interrupted
+static const int PollMilliseconds = 20;
+#endif
+
+/*
+ * Wait until the stream has data or has ended.
+ * Returns false if the read is interrupted first.
+ */
+static bool WaitForData(int fileDescriptor, const std::atomic<bool>& interrupted)
+{
+#ifdef _WIN32
+    // Pipes can not be polled like sockets, so the read itself waits
+    (void)fileDescriptor;
+    return !interrupted;
+#else
+    pollfd request = { fileDescriptor, POLLIN, 0 };
+    while (!interrupted)
+    {
+        // The end of the stream and errors count as ready too, the read reports them
+        int ready = poll(&request, 1, PollMilliseconds);
+        if (ready > 0) return true;
+        if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("StreamFrameSource: poll failed: ") + strerror(errno));
+        }
+    }
+    return false;
+#endif
+}
+
+/*
+ * Read up to size bytes, as many as the stream has ready. Returns 0 only at the end of the stream.
+ */
+static size_t ReadSome(int fileDescriptor, unsigned char* data, size_t size)
+{
+    while (true)
+    {
+#ifdef _WIN32
+        int count = _read(fileDescriptor, data, unsigned(std::min(size, size_t(1) << 30)));
+#else
+        ssize_t count = read(fileDescriptor, data, size);
+#endif
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("StreamFrameSource: read failed: ") + strerror(errno));
+        }
+        return size_t(count);
+    }
+}
+
+StreamFrameSource::StreamFrameSource(const std::string& filepath, unsigned int width, unsigned int height, StreamFormat format,
+    bool topDown, unsigned int threshold)
+    : StreamFrameSource(0, width, height, format, topDown, threshold)
+{
+    name = filepath;
+    if (filepath == "-") {
+#ifdef _WIN32
+        // Frames are binary, so standard input must not translate line endings
+        _setmode(0, _O_BINARY);
+#endif
+        return;
+    }
+
+#ifdef _WIN32
+    fileDescriptor = _open(filepath.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    fileDescriptor = open(filepath.c_str(), O_RDONLY);
+#endif
+    if (fileDescriptor < 0) {
+        throw std::runtime_error("StreamFrameSource: cannot open " + filepath + ": " + strerror(errno));
+    }
+    ownsDescriptor = true;
+}
+
+StreamFrameSource::StreamFrameSource(int fileDescriptor, unsigned int width, unsigned int height, StreamFormat format,
+    bool topDown, unsigned int threshold)
+    : fileDescriptor(fileDescriptor)
+    , ownsDescriptor(false)
+    , name("file descriptor " + std::to_string(fileDescriptor))
+    , width(width)
+    , height(height)
+    , format(format)
+    , topDown(topDown)
+    , threshold(threshold)
+    , rowBytes(format == StreamFormat::Bits ? (size_t(width) + 7) / 8 : width)
+    , nextFrameID(1)
+    , rawFilled(0)
+    , interrupted(false)
+{
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("StreamFrameSource: frames must not be empty");
+    }
+    raw.resize(FrameBytes() * KeptFrames);
+}
+
+StreamFrameSource::~StreamFrameSource()
+{
+    if (ownsDescriptor) {
+#ifdef _WIN32
+        _close(fileDescriptor);
+#else
+        close(fileDescriptor);
+#endif
+    }
+}
+
+unsigned int StreamFrameSource::Width() const
+{
+    return width;
+}
+
+unsigned int StreamFrameSource::Height() const
+{
+    return height;
+}
+
+unsigned int StreamFrameSource::FrameCount() const
+{
+    // The number of frames is only known when the writer closes the stream
+    return 0;
+}
+
+bool StreamFrameSource::Seekable() const
+{
+    return false;
+}
+
+bool StreamFrameSource::ReadFrame(unsigned int frameID, unsigned char* pixels)
+{
+    if (frameID == 0) {
+        return false;
+    }
+    if (frameID < nextFrameID) {
+        // The frame the stream is at may be half read into the place of the oldest frame
+        if (nextFrameID - frameID >= KeptFrames) {
+            return false;
+        }
+        Decode(RawFrame(frameID), pixels);
+        return true;
+    }
+    // Frames before the requested one are dropped
+    while (nextFrameID <= frameID)
+    {
+        if (!ReadRaw()) {
+            return false;
+        }
+        nextFrameID++;
+    }
+    Decode(RawFrame(frameID), pixels);
+    return true;
+}
+
+void StreamFrameSource::Interrupt(bool interrupted)
+{
+    this->interrupted = interrupted;
+}
+
+size_t StreamFrameSource::FrameBytes() const
+{
+    return rowBytes * height;
+}
+
+/*
+ * Private functions
+ */
+
+bool StreamFrameSource::ReadRaw()
+{
+    unsigned char* frame = RawFrame(nextFrameID);
+    size_t frameBytes = FrameBytes();
+    while (rawFilled < frameBytes)
+    {
+        if (!WaitForData(fileDescriptor, interrupted)) {
+            return false;
+        }
+        size_t count = ReadSome(fileDescriptor, frame + rawFilled, frameBytes - rawFilled);
+        if (count == 0) {
+            if (rawFilled == 0) {
+                return false;
+            }
+            throw std::runtime_error("StreamFrameSource: " + name + " ended in the middle of frame " + std::to_string(nextFrameID));
+        }
+        rawFilled += count;
+    }
+    rawFilled = 0;
+    return true;
+}
+
+unsigned char* StreamFrameSource::RawFrame(unsigned int frameID)
+{
+    return raw.data() + size_t((frameID - 1) % KeptFrames) * FrameBytes();
+}
+
+void StreamFrameSource::Decode(const unsigned char* frame, unsigned char* pixels) const
+{
+    for (unsigned int row = 0; row < height; row++)
+    {
+        const unsigned char* src = frame + size_t(row) * rowBytes;
+        // Frames are stored bottom row first
+        unsigned int y = topDown ? height - 1 - row : row;
+        unsigned char* dst = pixels + size_t(y) * width;
+
+        if (format == StreamFormat::Bits) {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                dst[x] = ((src[x >> 3] >> (7 - (x & 7))) & 1) ? UINT8_MAX : 0;
+            }
+        }
+        else {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                dst[x] = src[x] > threshold ? UINT8_MAX : 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#include "frametimings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+// Times below 8 ns have a bucket each, above that every doubling of the time is split into 8 buckets
+static const unsigned int SubBuckets = 8;
+static const unsigned int BucketCount = SubBuckets + 61 * SubBuckets;
+
+static const char* StageNames[size_t(FrameStage::Count)] = { "load", "decode", "points", "upload", "draw", "swap" };
+
+static inline double Milliseconds(double nanoseconds)
+{
+    return nanoseconds / 1.0e6;
+}
+
+FrameTimings::FrameTimings()
+{
+    for (Histogram& histogram : histograms)
+    {
+        histogram.buckets.resize(BucketCount);
+    }
+    Reset();
+}
+
+void FrameTimings::Record(FrameStage stage, Clock::duration time)
+{
+    int64_t count = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    uint64_t nanoseconds = count > 0 ? uint64_t(count) : 0;
+    unsigned int bucket = Bucket(nanoseconds);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Histogram& histogram = histograms[size_t(stage)];
+    histogram.count++;
+    histogram.sum += nanoseconds;
+    histogram.min = std::min(histogram.min, nanoseconds);
+    histogram.max = std::max(histogram.max, nanoseconds);
+    histogram.buckets[bucket]++;
+}
+
+StageStats FrameTimings::Stats(FrameStage stage) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Histogram& histogram = histograms[size_t(stage)];
+
+    StageStats stats = { 0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if (histogram.count == 0) {
+        return stats;
+    }
+    stats.count = histogram.count;
+    stats.min = Milliseconds(double(histogram.min));
+    stats.mean = Milliseconds(double(histogram.sum) / histogram.count);
+    stats.p50 = Milliseconds(Percentile(histogram, 0.50));
+    stats.p99 = Milliseconds(Percentile(histogram, 0.99));
+    stats.max = Milliseconds(double(histogram.max));
+    return stats;
+}
+
+void FrameTimings::WriteCSV(std::ostream& out) const
+{
+    out << "stage,count,min_ms,mean_ms,p50_ms,p99_ms,max_ms\n";
+    for (size_t i = 0; i < size_t(FrameStage::Count); i++)
+    {
+        StageStats stats = Stats(FrameStage(i));
+        out << StageNames[i] << ',' << stats.count << ',' << stats.min << ',' << stats.mean << ','
+            << stats.p50 << ',' << stats.p99 << ',' << stats.max << '\n';
+    }
+}
+
+void FrameTimings::WriteCSV(const std::string& filepath) const
+{
+    std::ofstream out(filepath);
+    if (!out) {
+        throw std::runtime_error("FrameTimings: cannot open " + filepath + " for writing");
+    }
+    WriteCSV(out);
+    if (!out) {
+        throw std::runtime_error("FrameTimings: cannot write " + filepath);
+    }
+}
+
+void FrameTimings::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Histogram& histogram : histograms)
+    {
+        histogram.count = 0;
+        histogram.sum = 0;
+        histogram.min = std::numeric_limits<uint64_t>::max();
+        histogram.max = 0;
+        std::fill(histogram.buckets.begin(), histogram.buckets.end(), 0);
+    }
+}
+
+const char* FrameTimings::StageName(FrameStage stage)
+{
+    return StageNames[size_t(stage)];
+}
+
+/*
+ * Private functions
+ */
+
+unsigned int FrameTimings::Bucket(uint64_t nanoseconds)
+{
+    if (nanoseconds < SubBuckets) {
+        return unsigned(nanoseconds);
+    }
+    // Shift the time down to 8..15, the 8 buckets of its doubling
+    unsigned int shift = 0;
+    while ((nanoseconds >> shift) >= 2 * SubBuckets) {
+        shift++;
+    }
+    return SubBuckets + shift * SubBuckets + unsigned(nanoseconds >> shift) - SubBuckets;
+}
+
+uint64_t FrameTimings::BucketEnd(unsigned int bucket)
+{
+    if (bucket < SubBuckets) {
+        return bucket + 1;
+    }
+    unsigned int shift = (bucket - SubBuckets) / SubBuckets;
+    uint64_t sub = (bucket - SubBuckets) % SubBuckets;
+    return (SubBuckets + sub + 1) << shift;
+}
+
+double FrameTimings::Percentile(const Histogram& histogram, double fraction)
+{
+    // The end of the bucket which holds the time, but never more than the largest time
+    uint64_t rank = uint64_t(std::ceil(fraction * histogram.count));
+    uint64_t seen = 0;
+    for (unsigned int bucket = 0; bucket < BucketCount; bucket++)
+    {
+        seen += histogram.buckets[bucket];
+        if (seen >= rank && seen > 0) {
+            return double(std::min(BucketEnd(bucket), histogram.max));
+        }
+    }
+    return double(histogram.max);
+}
+
+/*
+ * \class StageTimer
+ */
+
+StageTimer::StageTimer(FrameTimings& timings, FrameStage stage)
+    : timings(timings)
+    , stage(stage)
+    , start(FrameTimings::Clock::now())
+{
+}
+
+StageTimer::~StageTimer()
+{
+    timings.Record(stage, FrameTimings::Clock::now() - start);
+}
@@ -0,0 +1,65 @@
+#include "levelselector.h"
+
+LevelSelector::LevelSelector(unsigned int levelCount, unsigned int missesToDownshift, unsigned int hitsToUpshift)
+    : levelCount(levelCount > 0 ? levelCount : 1)
+    , missesToDownshift(missesToDownshift)
+    , hitsToUpshift(hitsToUpshift)
+    , level(0)
+    , largestLevel(0)
+    , misses(0)
+    , hits(0)
+    , downshifts(0)
+    , upshifts(0)
+{
+}
+
+void LevelSelector::SetLargestLevel(unsigned int level)
+{
+    largestLevel = level < levelCount ? level : levelCount - 1;
+    if (this->level < largestLevel) {
+        this->level = largestLevel;
+        misses = 0;
+        hits = 0;
+    }
+}
+
+unsigned int LevelSelector::Update(double frameMilliseconds, double budgetMilliseconds)
+{
+    if (frameMilliseconds > budgetMilliseconds) {
+        hits = 0;
+        if (++misses >= missesToDownshift && level + 1 < levelCount) {
+            level++;
+            downshifts++;
+            misses = 0;
+        }
+    }
+    else {
+        misses = 0;
+        if (frameMilliseconds < budgetMilliseconds * UpshiftFraction) {
+            if (++hits >= hitsToUpshift && level > largestLevel) {
+                level--;
+                upshifts++;
+                hits = 0;
+            }
+        }
+        else {
+            hits = 0;
+        }
+    }
+    return level;
+}
+
+unsigned int LevelSelector::Level() const
+{
+    return level;
+}
+
+uint64_t LevelSelector::Downshifts() const
+{
+    return downshifts;
+}
+
+uint64_t LevelSelector::Upshifts() const
+{
+    return upshifts;
+}
@@ -0,0 +1,54 @@
+#include "options.h"
+
+#include <sstream>
+
+int ParseNumber(const std::string& text, const std::string& option)
+{
+    size_t length = 0;
+    int number = 0;
+    try {
+        number = std::stoi(text, &length);
+    }
+    catch (std::exception&) {
+        // Not a number, or out of the range of int
+        length = 0;
+    }
+    if (length == 0 || length != text.size()) {
+        throw std::runtime_error(option + " needs a whole number, not \"" + text + "\"");
+    }
+    return number;
+}
+
+double ParseDecimal(const std::string& text, const std::string& option)
+{
+    size_t length = 0;
+    double number = 0;
+    try {
+        number = std::stod(text, &length);
+    }
+    catch (std::exception&) {
+        length = 0;
+    }
+    if (length == 0 || length != text.size()) {
+        throw std::runtime_error(option + " needs a number, not \"" + text + "\"");
+    }
+    return number;
+}
+
+std::vector<unsigned int> ParseScales(const std::string& text, const std::string& option)
+{
+    std::vector<unsigned int> scales;
+    std::stringstream list(text);
+    std::string scale;
+    while (std::getline(list, scale, ',')) {
+        int number = ParseNumber(scale, option);
+        if (number < 1) {
+            throw std::runtime_error(option + " needs scales of at least 1, not " + scale);
+        }
+        scales.push_back(unsigned(number));
+    }
+    if (scales.empty()) {
+        throw std::runtime_error(option + " needs at least one scale");
+    }
+    return scales;
+}
@@ -3,17 +3,197 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <sstream>
+#include <thread>
+#include <vector>
 #define _SILENCE_EXPERIMENTAL_FILESYSTEM_DEPRECATION_WARNING 1;
 #include <experimental/filesystem>
 
+#include "bmpfile.h"
+#include "framearchive.h"
+#include "framehash.h"
+#include "framereduce.h"
+#include "options.h"
+
 using namespace cv;
 
-int main(int argc, char** argv) {
+/**
+ * How the frames are extracted
+ * \param videoPath - the video to extract the frames from.
+ * \param n - every n-th frame of the video is saved.
+ * \param bitsPerPixel - the bits per pixel of the bmp files, 1 or 8. The frames are thresholded to black and white
+ *                       before they are written, so 8 bit files hold the same two values in 8 times the space, for
+ *                       tools which do not read 1 bit files.
+ * \param scale - the frames are scaled down to 48x36 by default. --scale 1 keeps the full 480x360 frames, which the
+ *                player packs into the levels given with its --levels, like 1,2,5,10 for 480x360 down to 48x36.
+ * \param threshold - gray values above this are white.
+ * \param filter - nearest samples one pixel of the video per pixel of the frame, area averages the pixels it covers.
+ * \param preview - if true the frames are shown in a window while they are extracted, one at a time.
+ * \param workers - the number of threads decoding the video in batch mode.
+ * \param archivePath - if not empty, the frames are packed into this frame archive instead of bmp files.
+ * \param keyframeInterval - the maximum distance between keyframes in the archive. 0 stores plain bits only.
+ * \param levelScales - the levels of the archive, as divisors of the frame size.
+ */
+struct ExtractSettings {
+    std::string videoPath = "Data/BadApple.mp4";
+    int n = 5;
+    unsigned int bitsPerPixel = 1;
+    double scale = 0.1;
+    double threshold = 175;
+    ReduceFilter filter = ReduceFilter::Nearest;
+    bool preview = false;
+    unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+    std::string archivePath;
+    unsigned int keyframeInterval = FrameArchive::DefaultKeyframeInterval;
+    std::vector<unsigned int> levelScales = { 1 };
+};
+
+// The number of saved frames each worker decodes between seeks. A chunk is one time range of the video.
+static const int ChunkFrames = 64;
+// How many frames before a chunk a worker sets the capture to. Backends may land a little after the frame which
+// was asked for, e.g. in videos with B-frames, so the worker lands early and grabs forward to the chunk.
+static const int SeekLead = 16;
+
+/**
+ * The buffers a frame passes through on its way to a bitmap. They are kept from frame to frame,
+ * so OpenCV only allocates them once.
+ */
+struct ConvertBuffers {
+    Mat frame;
+};
+
+/**
+ * Read the next frame to keep. The frames before it are only grabbed, so they are not converted to colour.
+ * \param skip - the number of frames to drop first.
+ * \return false at the end of the video.
+ */
+bool ReadKeptFrame(VideoCapture& cap, int skip, ConvertBuffers& buffers)
+{
+    for (int i = 0; i < skip; i++)
+    {
+        if (!cap.grab()) return false;
+    }
+    return cap.grab() && cap.retrieve(buffers.frame);
+}
+
+/**
+ * Move the capture to a frame of the video. A capture which is a little before the frame grabs forward to it,
+ * otherwise it is set to a frame before it and grabs forward from the position it reports. If that position is
+ * still after the frame, the capture is set further back.
+ * A runtime_error is thrown if even the start of the video can not be reached.
+ * \param target - the frame to move to, counting from 0.
+ * \param position - the frame the capture is at, or -1 if it is not known. Receives target.
+ * \return false if the video ends before the frame.
+ */
+bool SeekToFrame(VideoCapture& cap, int target, int& position)
+{
+    if (position < 0 || position > target || target - position > SeekLead) {
+        for (int lead = SeekLead; ; lead *= 2)
+        {
+            int start = std::max(0, target - lead);
+            cap.set(CAP_PROP_POS_FRAMES, double(start));
+            position = int(cap.get(CAP_PROP_POS_FRAMES));
+            if (position >= 0 && position <= target) break;
+            if (start == 0) {
+                throw std::runtime_error("SeekToFrame(): could not seek to frame " + std::to_string(target));
+            }
+        }
+    }
+    for (; position < target; position++)
+    {
+        if (!cap.grab()) return false;
+    }
+    return true;
+}
+
+/**
+ * Convert the frame in buffers to a smaller binary grayscale bitmap, bottom row first like the frames are read.
+ * \param binary - receives the bitmap. Its memory is reused if it already has the right size.
+ */
+void ConvertFrame(ConvertBuffers& buffers, const ExtractSettings& settings, Mat& binary)
+{
+    const Mat& frame = buffers.frame;
+    if (frame.type() != CV_8UC3) {
+        throw std::runtime_error("ConvertFrame(): the video frames are not 8 bit BGR");
+    }
+
+    // Rounded like the size cv::resize picks for a scale factor
+    int width = std::max(1, int(frame.cols * settings.scale + 0.5));
+    int height = std::max(1, int(frame.rows * settings.scale + 0.5));
+    unsigned int threshold = unsigned(std::min(std::max(settings.threshold, 0.0), double(UINT8_MAX)));
+
+    // Scale, convert to gray, threshold and flip in one pass over the frame
+    binary.create(height, width, CV_8UC1);
+    ReduceFrame(frame.data, frame.cols, frame.rows, frame.step, width, height, threshold, settings.filter, binary.data);
+}
+
+/**
+ * Where the converted frames are saved: one bmp file per frame in the Frames folder,
+ * or one frame archive which is written front to back and gets its frame index when it is closed.
+ */
+class FrameOutput {
+public:
+    FrameOutput(const ExtractSettings& settings)
+        : settings(settings)
+    {
+        if (settings.archivePath.empty()) {
+            // Create a 'Frames' folder we can save the images in
+            std::experimental::filesystem::path root = std::experimental::filesystem::current_path();
+            std::experimental::filesystem::create_directories(root / "Frames");
+        }
+    }
+
+    /**
+     * Save a converted frame. Frames must be saved in order.
+     * \param number - the number of the saved frame, starting at 1.
+     */
+    void Save(int number, const Mat& binary)
+    {
+        if (settings.archivePath.empty()) {
+            WriteBMP("Frames/frame_" + std::to_string(number) + ".bmp", binary.cols, binary.rows, binary.data, settings.bitsPerPixel);
+            return;
+        }
+        // The size of the frames is known once the first one is converted
+        if (!archive) {
+            archive.reset(new FrameArchiveWriter(settings.archivePath, binary.cols, binary.rows, number,
+                settings.keyframeInterval, settings.levelScales));
+        }
+        archive->AddFrame(binary.data);
+    }
+
+    /**
+     * Write the frame index of the archive.
+     */
+    void Close()
+    {
+        if (archive) {
+            archive->Close();
+            std::cout << "Packed " << archive->FrameCount() << " frames into " << settings.archivePath << ", "
+                << archive->SharedFrames() << " of them share the payload of an equal frame" << std::endl;
+        }
+    }
+
+private:
+    const ExtractSettings& settings;
+    std::unique_ptr<FrameArchiveWriter> archive;
+};
+
+/**
+ * Extract the frames one at a time while showing them in a window.
+ */
+int RunPreview(const ExtractSettings& settings)
+{
     // Open video file
-    VideoCapture cap("Data/BadApple.mp4");
+    VideoCapture cap(settings.videoPath);
     if (!cap.isOpened())
     {
         std::cout << "Cannot open the video file" << std::endl;
@@ -25,47 +205,398 @@ int main(int argc, char** argv) {
     std::cout << "Frame per seconds : " << fps << std::endl;
     // Create a window called "MyVideo"
     namedWindow("MyVideo", WINDOW_AUTOSIZE);
-    // Create a 'Frames' folder we can save the images in
-    std::experimental::filesystem::path root = std::experimental::filesystem::current_path();
-    std::experimental::filesystem::create_directories(root / "Frames");
 
-    // c is the frame count. We will save every n-th frame. 
+    // c is the number of saved frames. We will save every n-th frame.
     int c = 0;
-    int n = 5;
+    FrameOutput output(settings);
+    ConvertBuffers buffers;
+    Mat binary;
     while (true)
     {
-        // attempt to read a frame from the video
-        Mat frame;
-        if (!cap.read(frame))
+        // attempt to read the next n-th frame from the video
+        if (!ReadKeptFrame(cap, settings.n - 1, buffers))
         {
             std::cout << "Cannot read the frame from video file" << std::endl;
             break;
         }
 
         c++;
-        // Save every n-th frame
-        if (c % n == 0)
+        // show the frame in a window
+        imshow("MyVideo", buffers.frame);
+
+        ConvertFrame(buffers, settings, binary);
+        output.Save(c, binary);
+
+        // exit if esc key is pressed
+        if (waitKey(30) == 27)
         {
-            // show the frame in a window
-            imshow("MyVideo", frame);
+            std::cout << "esc key is pressed by user" << std::endl;
+            break;
+        }
+    }
+    output.Close();
 
-            // convert frame to a smaller binary grayscale bitmap
-            Mat smaller, gray, binary;
-            resize(frame, smaller, Size(), 0.1, 0.1, INTER_NEAREST);
-            smaller.convertTo(gray, CV_8UC1);
-            threshold(gray, binary, 175, UINT8_MAX, THRESH_BINARY);
+    return 0;
+}
 
-            // save image file in the Frames folder
-            imwrite("Frames/frame_" + std::to_string(c / n) + ".bmp", binary);
+/**
+ * Converted frames handed from the workers to the writer, which takes them in order.
+ * Workers wait before decoding a chunk which is too far ahead of the writer, so only a few chunks are held.
+ * The writer gives the bitmaps back when they are saved, and the workers convert the next frames into them.
+ */
+class OrderedFrames {
+public:
+    OrderedFrames(unsigned int workers)
+        : workers(workers)
+        , nextToWrite(1)
+        , endOfVideo(std::numeric_limits<int>::max())
+    {
+    }
 
-            // exit if esc key is pressed
-            if (waitKey(30) == 27)
-            {
-                std::cout << "esc key is pressed by user" << std::endl;
+    /**
+     * A worker failed. The first error is kept for the writer, and the video ends so the other workers stop.
+     */
+    void Fail(std::exception_ptr failure)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+            error = failure;
+        }
+        endOfVideo = 0;
+        changed.notify_all();
+    }
+
+    /**
+     * \return the error of the first worker which failed, or null.
+     */
+    std::exception_ptr Error()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return error;
+    }
+
+    /**
+     * The start of every chunk a worker seeks to is decoded twice: after the seek, and by the worker of the chunk
+     * before it, which decodes on past its end. The two must be equal, or the seek did not land on the first frame.
+     * The first of the two to arrive is kept until the other one does.
+     * A runtime_error is thrown if they differ.
+     * \param number - the number of the first frame of a chunk.
+     * \param hashes - the HashFrame() of the converted frames at the start of the chunk, see ChunkStartComplete().
+     */
+    void CheckChunkStart(int number, const std::vector<uint64_t>& hashes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<int, std::vector<uint64_t>>::iterator other = chunkStarts.find(number);
+        if (other == chunkStarts.end()) {
+            chunkStarts[number] = hashes;
+            return;
+        }
+        bool equal = other->second == hashes;
+        chunkStarts.erase(other);
+        if (!equal) {
+            throw std::runtime_error("CheckChunkStart(): the seek to saved frame " + std::to_string(number) +
+                " did not land on it, the video can not be seeked exactly. Extract it with --workers 1");
+        }
+    }
+
+    /**
+     * Wait until the writer is close enough to the first frame of a chunk.
+     * \return false if the chunk is past the end of the video.
+     */
+    bool WaitForChunk(int chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        int first = chunk * ChunkFrames + 1;
+        changed.wait(lock, [&] {
+            return first >= endOfVideo || first < nextToWrite + int(2 * workers) * ChunkFrames;
+        });
+        return first < endOfVideo;
+    }
+
+    /**
+     * \return a bitmap which has been written, or an empty one.
+     */
+    Mat Acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spare.empty()) {
+            return Mat();
+        }
+        Mat binary = spare.back();
+        spare.pop_back();
+        return binary;
+    }
+
+    /**
+     * Give back a bitmap which has been written. The caller must not hold on to it.
+     */
+    void Recycle(Mat& binary)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(binary);
+        binary.release();
+    }
+
+    void Put(int number, Mat binary)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready[number] = binary;
+        changed.notify_all();
+    }
+
+    /**
+     * A worker could not read the frame with this number, so the video ends before it.
+     */
+    void End(int number)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        endOfVideo = std::min(endOfVideo, number);
+        changed.notify_all();
+    }
+
+    void WorkerDone()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers--;
+        changed.notify_all();
+    }
+
+    /**
+     * Wait for the next frame in order.
+     * \return false when there are no more frames.
+     */
+    bool Take(int& number, Mat& binary)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] {
+            return ready.count(nextToWrite) != 0 || nextToWrite >= endOfVideo || workers == 0;
+        });
+        std::map<int, Mat>::iterator frame = ready.find(nextToWrite);
+        if (frame == ready.end() || nextToWrite >= endOfVideo) {
+            return false;
+        }
+        number = frame->first;
+        binary = frame->second;
+        ready.erase(frame);
+        nextToWrite++;
+        changed.notify_all();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<int, Mat> ready;
+    std::vector<Mat> spare;
+    std::map<int, std::vector<uint64_t>> chunkStarts;
+    std::exception_ptr error;
+    unsigned int workers;
+    int nextToWrite;
+    int endOfVideo;
+};
+
+/**
+ * Find out whether enough of the start of a chunk has been hashed to check a seek to it. That is up to and including
+ * the first frame which differs from the frame before it, or the whole chunk. Bad Apple has long runs of equal
+ * frames, and a seek which lands late in one has the same first frame as the chunk, but reaches the end of the run
+ * early.
+ * \param hashes - the hashes of the frames from the start of the chunk on.
+ */
+bool ChunkStartComplete(const std::vector<uint64_t>& hashes)
+{
+    size_t count = hashes.size();
+    return count >= size_t(ChunkFrames) || (count >= 2 && hashes[count - 1] != hashes[count - 2]);
+}
+
+/**
+ * Decode chunks of the video with a VideoCapture of its own until the end of the video.
+ * Errors are handed to the writer, since an exception must not escape the thread.
+ */
+void ExtractChunks(const ExtractSettings& settings, std::atomic<int>& nextChunk, OrderedFrames& frames)
+{
+    try {
+        VideoCapture cap(settings.videoPath);
+        if (!cap.isOpened())
+        {
+            std::cout << "Cannot open the video file" << std::endl;
+            frames.End(1);
+            frames.WorkerDone();
+            return;
+        }
+
+        ConvertBuffers buffers;
+        Mat boundary;
+        std::vector<uint64_t> startHashes;
+        int position = 0;
+        int chunk = nextChunk++;
+        while (frames.WaitForChunk(chunk))
+        {
+            // The saved frame number k is frame k * n of the video, counting from 1
+            int first = chunk * ChunkFrames + 1;
+            bool seeked = position != (first - 1) * settings.n;
+            if (!SeekToFrame(cap, (first - 1) * settings.n, position)) {
+                frames.End(first);
                 break;
             }
+            bool checking = seeked;
+            startHashes.clear();
+            bool ended = false;
+            for (int number = first; number < first + ChunkFrames; number++)
+            {
+                if (!ReadKeptFrame(cap, settings.n - 1, buffers))
+                {
+                    frames.End(number);
+                    ended = true;
+                    break;
+                }
+                position += settings.n;
+                Mat binary = frames.Acquire();
+                ConvertFrame(buffers, settings, binary);
+                if (checking) {
+                    startHashes.push_back(HashFrame(binary.data, size_t(binary.rows) * binary.cols));
+                    if (ChunkStartComplete(startHashes)) {
+                        frames.CheckChunkStart(first, startHashes);
+                        checking = false;
+                    }
+                }
+                frames.Put(number, binary);
+            }
+            // The video ended in the frames which are checked
+            if (checking) {
+                frames.CheckChunkStart(first, startHashes);
+            }
+            if (ended) break;
+
+            // Another worker seeks to the next chunk, so decode on into it to check where that worker lands.
+            // The next chunk of this worker is decoded on from here if it is that chunk.
+            int next = nextChunk++;
+            if (next != chunk + 1) {
+                startHashes.clear();
+                while (!ChunkStartComplete(startHashes))
+                {
+                    if (!ReadKeptFrame(cap, settings.n - 1, buffers)) {
+                        position = -1;
+                        break;
+                    }
+                    position += settings.n;
+                    ConvertFrame(buffers, settings, boundary);
+                    startHashes.push_back(HashFrame(boundary.data, size_t(boundary.rows) * boundary.cols));
+                }
+                frames.CheckChunkStart(first + ChunkFrames, startHashes);
+            }
+            chunk = next;
         }
     }
+    catch (...) {
+        frames.Fail(std::current_exception());
+    }
+    frames.WorkerDone();
+}
 
-    return 0;
-}
\ No newline at end of file
+/**
+ * Extract the frames without a window, with worker threads decoding separate time ranges of the video.
+ * The frames are written in order as soon as they are ready.
+ */
+int RunBatch(const ExtractSettings& settings)
+{
+    std::cout << "Extracting with " << settings.workers << " workers (" << FrameReduceInstructionSet() << ")" << std::endl;
+    std::chrono::time_point<std::chrono::steady_clock> startTime = std::chrono::steady_clock::now();
+
+    FrameOutput output(settings);
+    OrderedFrames frames(settings.workers);
+    std::atomic<int> nextChunk(0);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < settings.workers; i++)
+    {
+        workers.push_back(std::thread(ExtractChunks, std::cref(settings), std::ref(nextChunk), std::ref(frames)));
+    }
+
+    int written = 0;
+    int number;
+    Mat binary;
+    try {
+        while (frames.Take(number, binary))
+        {
+            output.Save(number, binary);
+            frames.Recycle(binary);
+            written++;
+        }
+        // A worker may still be checking the start of a chunk which has been written already
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        // A worker which failed ended the video early or found a seek which missed, so the frames are not right
+        if (std::exception_ptr error = frames.Error()) {
+            std::rethrow_exception(error);
+        }
+        output.Close();
+    }
+    catch (...) {
+        // Stop the workers before giving up
+        frames.End(0);
+        for (std::thread& worker : workers)
+        {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        throw;
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    std::cout << "Extracted " << written << " frames in " << elapsed.count() << " seconds ("
+        << written / elapsed.count() << " frames per second)" << std::endl;
+    return written > 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    try {
+        ExtractSettings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+            if (argument == "--preview") {
+                settings.preview = true;
+            }
+            else if (argument == "--workers" && i + 1 < argc) {
+                settings.workers = std::max(1, ParseNumber(argv[++i], argument));
+            }
+            else if (argument == "--scale" && i + 1 < argc) {
+                settings.scale = ParseDecimal(argv[++i], argument);
+                if (!(settings.scale > 0 && settings.scale <= 1)) {
+                    throw std::runtime_error("main(): --scale needs a factor above 0 and at most 1");
+                }
+            }
+            else if (argument == "--bits" && i + 1 < argc) {
+                int bits = ParseNumber(argv[++i], argument);
+                if (bits != 1 && bits != 8) {
+                    throw std::runtime_error("main(): --bits needs 1 or 8, not " + std::to_string(bits));
+                }
+                settings.bitsPerPixel = unsigned(bits);
+            }
+            else if (argument == "--area") {
+                settings.filter = ReduceFilter::Area;
+            }
+            else if (argument == "--archive" && i + 1 < argc) {
+                settings.archivePath = argv[++i];
+            }
+            else if (argument == "--keyframes" && i + 1 < argc) {
+                settings.keyframeInterval = unsigned(std::max(0, ParseNumber(argv[++i], argument)));
+            }
+            else if (argument == "--levels" && i + 1 < argc) {
+                // A comma separated list of scales, like 1,2,5,10
+                settings.levelScales = ParseScales(argv[++i], argument);
+            }
+            else {
+                settings.videoPath = argument;
+            }
+        }
+
+        return settings.preview ? RunPreview(settings) : RunBatch(settings);
+    }
+    catch (std::exception const& runtimeerror) {
+        std::cerr << "Exception: " << runtimeerror.what() << std::endl;
+        return 1;
+    }
+}